@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Patch.h"
 #include <stdint.h>
 #include <cmath>
 
@@ -9,12 +10,30 @@ constexpr int32_t kHlskChaosNoisePhsMsk = 0x0FFFFFFL;
 /**
  * @brief A noise generator that uses a chaos function to produce sound.
  *        Ported from https://pbat.ch/sndkit/chaosnoise/
+ *        It can also generate a block at a time.
  */
 class ChaosNoise
 {
 public:
-    ChaosNoise() {}
-    ~ChaosNoise() {}
+    ChaosNoise(float sampleRate, size_t blockSize)
+    {
+        Init(sampleRate);
+        block_ = FloatArray::create(blockSize);
+    }
+    ~ChaosNoise()
+    {
+        FloatArray::destroy(block_);
+    }
+
+    static ChaosNoise* create(float sampleRate, size_t blockSize)
+    {
+        return new ChaosNoise(sampleRate, blockSize);
+    }
+
+    static void destroy(ChaosNoise* obj)
+    {
+        delete obj;
+    }
 
     /**
      * @param sampleRate
@@ -50,11 +69,12 @@ public:
     void SetFreq(float freq)
     {
         freq_ = freq;
+        inc_ = floor(freq_ * maxlens_);
     }
 
     float noise()
     {
-        phs_ += floor(freq_ * maxlens_);
+        phs_ += inc_;
 
         if (phs_ >= kHlskChaosNoisePhsMax) {
             float y;
@@ -79,8 +99,25 @@ public:
         return noise();
     }
 
+    // Fills the block, called once per block.
+    void Generate()
+    {
+        float* out = block_.getData();
+        size_t size = block_.getSize();
+        for (size_t i = 0; i < size; i++)
+        {
+            out[i] = noise();
+        }
+    }
+
+    FloatArray GetBlock()
+    {
+        return block_;
+    }
+
 private:
+    FloatArray block_;
     float y_[2];
     float maxlens_, chaos_, freq_;
-    int32_t phs_;
+    int32_t phs_, inc_;
 };
@@ -10,6 +10,8 @@
 //#define USE_RECORD_THRESHOLD
 #define MAX_PATCH_SETTINGS 16 // Max number of available MIDI channels
 #define PATCH_SETTINGS_NAME "oneiroi"
+#define ALT_PARAMS_VERSION 2 // Stored as the last alt value, 0 in the files saved before it
+#define LOOPER_WAV_NAME PATCH_SETTINGS_NAME ".wav" // Loaded into the looper at startup, if present
 #define PATCH_VERSION_MAJOR 1
 #define PATCH_VERSION_MINOR 1
 
@@ -69,6 +71,7 @@ constexpr int kRandomSlewSamples = 128;
 constexpr float kA4Freq = 440.f;
 constexpr int kA4Note = 69;
 constexpr float kSemi4Oct = 12;
+constexpr int kExp2TableSize = 32;
 constexpr float kOscFreqMin = 16.35f; // C0
 constexpr float kOscFreqMax = 8219.f; // C9
 
@@ -89,6 +92,7 @@ constexpr float kLooperMakeupGain = 1.3f;
 constexpr int kLooperClearBlocks = 128; // Number of blocks of the buffer to be cleared
 static const int32_t kLooperClearBlockSize = kLooperTotalBufferLength / kLooperClearBlocks;
 static const int32_t kLooperClearBlockTypeSize = kLooperClearBlockSize * 4; // Float
+constexpr uint32_t kLooperWavChunkFrames = 256; // Frames converted per block when importing
 
 constexpr float kRecordOnsetLevel = 0.005f;
 constexpr float kRecordWindupLevel = 0.00001f;
@@ -99,6 +103,12 @@ constexpr int kWaveTableLength = 2048;
 constexpr int kWaveTableNofTables = 32;
 static const int kWaveTableStepLength = kLooperChannelBufferLength / kWaveTableNofTables;
 static const float kWaveTableNofTablesR = 1.f / kWaveTableNofTables;
+constexpr int kWaveTableMipLevels = 10; // Level 0 is the looper's audio, each following one is half the length (down to 4 samples)
+constexpr int kWaveTableMipChunk = 256; // Samples of the mip levels rebuilt per block
+constexpr size_t kWaveTableSubBlockSize = 16; // Samples between table selections
+constexpr int kWaveTableMaxVoices = 8;
+constexpr float kWaveTableUnisonSpread = 0.02f; // Detune of the outer voices at full detune, as a ratio
+constexpr int kWaveTableCacheChunk = 256; // Samples per channel and table copied to the cache per block
 
 // When internally clocked, base frequency is ~0.18Hz
 // When externally clocked, min bpm is 30 (0.5Hz), max is 300 (5Hz)
@@ -114,7 +124,16 @@ constexpr float kClockTempoSamplesMin = 48; // Minimum number of tempo's samples
 
 constexpr float kOScSineGain = 0.3f;
 static const float kOscSineFadeInc = 1.f / 2400;
+constexpr size_t kOscSineTableSize = 1024;
+constexpr int kOscSineMaxPartials = 8;
+constexpr int kOscSinePartials = 8; // Partials of the additive modes
+constexpr int kOscSineSubOctaves = 4; // Down to three octaves below, lower ones would be subsonic
+constexpr float kOscSineTilt = 0.6f; // Gain ratio between a partial and the previous one
 constexpr float kOScSuperSawGain = 0.4f;
+constexpr size_t kSuperSawMinVoices = 3;
+constexpr size_t kSuperSawMaxVoices = 16;
+constexpr size_t kSuperSawVoices = 7;
+constexpr float kOscVoicesDefault = float(kSuperSawVoices - kSuperSawMinVoices) / (kSuperSawMaxVoices - kSuperSawMinVoices); // Osc2 voices alt param
 constexpr float kOScWaveTablePreGain = 6.f;
 constexpr float kOScWaveTableGain = 0.3f;
 constexpr float kSourcesMakeupGain = 0.2f;
@@ -122,6 +141,10 @@ constexpr float kSourcesMakeupGain = 0.2f;
 constexpr float kDjFilterMakeupGainMin = 1.f;
 constexpr float kDjFilterMakeupGainMax = 1.4f;
 
+constexpr int kFilterCutoffTableSize = 512; // Points of the cutoff to SVF coefficient table
+constexpr float kFilterCombFreqMin = 100.f;
+constexpr float kFilterCombFixedGain = 0.7f * (1.f - 0.7f); // Feedback of the comb's fixed 2 samples stages
+constexpr float kFilterMorphWidth = 0.1f; // Width of the crossfade between low, band and high pass on the mode knob
 constexpr float kFilterFreqMin = 10.f;
 constexpr float kFilterFreqMax = 22000.f;
 constexpr float kFilterMakeupGain = 2.4f;
@@ -134,6 +157,11 @@ constexpr float kFilterBpGainMin = 0.2f;
 constexpr float kFilterBpGainMax = 0.4f;
 constexpr float kFilterCombGainMin = 0.1f;
 constexpr float kFilterCombGainMax = 0.2f;
+constexpr size_t kFilterFormants = 5;
+constexpr float kFilterFormantSharpnessMin = 0.5f;
+constexpr float kFilterFormantSharpnessMax = 4.f;
+constexpr float kFilterFormantGainMin = 0.4f;
+constexpr float kFilterFormantGainMax = 0.8f;
 
 constexpr float kResoGainMin = 0.5f;
 constexpr float kResoGainMax = 1.2f;
@@ -141,13 +169,23 @@ constexpr float kResoMakeupGain = 1.f;
 constexpr int32_t kResoBufferSize = 2400;
 constexpr float kResoInfiniteFeedbackThreshold = 0.999f;
 constexpr float kResoInfiniteFeedbackLevel = 1.001f;
+constexpr float kResoDcLambda = 0.995f;
+constexpr float kResoEnvLambda = 0.995f;
+constexpr size_t kResoMaxStrings = 16;
+constexpr size_t kResoMaxPoles = kResoMaxStrings - 1; // The first pole is stereo
+constexpr size_t kResoPoles = 3;
+constexpr size_t kResoModes = 16; // Per channel, 32 filters in all
+constexpr float kResoModalDecayMin = 0.2f; // Seconds
+constexpr float kResoModalDecayMax = 20.f;
+constexpr float kResoModalDamping = 0.15f;
+constexpr float kResoModalSpread = 0.003f;
+constexpr float kResoModalGain = 8.f; // The output is normalized by the number of modes
 
 constexpr int32_t kEchoFadeSamples = 2400; // 50 ms @ audio rate
+constexpr float kEchoDensitySmoothing = 4.f / kEchoFadeSamples; // One-pole coefficient of the tap times with the internal clock
 constexpr int32_t kEchoMinLengthSamples = 480; // 10 ms @ audio rate
 constexpr int32_t kEchoMaxLengthSamples = 192000; // 4 seconds @ audio rate
-constexpr int kEchoTaps = 4;
-const float kEchoTapsRatios[kEchoTaps] = { 0.75f, 0.25f, 0.375f, 1.f };  // TAP_LEFT_A (1/2 dot), TAP_LEFT_B (1/8), TAP_RIGHT_A (1/8 dot), TAP_RIGHT_B (1)
-const float kEchoTapsFeedbacks[kEchoTaps] = { 0.35f, 0.65f, 0.55f, 0.45f };
+constexpr size_t kEchoMaxTaps = 16;
 const int32_t kEchoMaxExternalClockSamples = kEchoMaxLengthSamples / kModClockRatios[kClockNofRatios - 1]; // Maximum period for the external clock
 constexpr int kEchoExternalClockMultiplier = 32;
 constexpr int kEchoInternalClockMultiplier = 23; // ~192000 / 8192 (period of the buffer)
@@ -156,6 +194,75 @@ constexpr float kEchoInfiniteFeedbackLevel = 1.001f;
 constexpr int kEchoCompThresMin = -16;
 constexpr int kEchoCompThresMax = -22;
 constexpr float kEchoMakeupGain = 1.2f;
+constexpr float kEchoPatternFadeInc = 1.f / kEchoFadeSamples; // Crossfade between the taps of two patterns
+
+enum EchoPattern
+{
+    ECHO_PATTERN_DEFAULT,
+    ECHO_PATTERN_PING_PONG,
+    ECHO_PATTERN_GOLDEN,
+    ECHO_PATTERN_DOTTED,
+    ECHO_PATTERN_SWING,
+    ECHO_PATTERN_NOF_PATTERNS,
+};
+
+struct EchoTapPattern
+{
+    size_t taps;
+    float ratios[kEchoMaxTaps]; // Of the echo time, up to 1
+    float feedbacks[kEchoMaxTaps];
+    int sources[kEchoMaxTaps]; // Line the tap reads
+    int destinations[kEchoMaxTaps]; // Line the tap feeds back into
+    float pans[kEchoMaxTaps]; // -1 (left) to 1 (right)
+};
+
+static const EchoTapPattern kEchoTapPatterns[ECHO_PATTERN_NOF_PATTERNS] = {
+    // 1/2 dot, 1/8, 1/8 dot, 1
+    {
+        4,
+        { 0.75f, 0.25f, 0.375f, 1.f },
+        { 0.35f, 0.65f, 0.55f, 0.45f },
+        { LEFT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, RIGHT_CHANNEL },
+        { LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL },
+        { -1.f, -1.f, 1.f, 1.f },
+    },
+    // 16ths bouncing between the channels
+    {
+        16,
+        { 0.0625f, 0.125f, 0.1875f, 0.25f, 0.3125f, 0.375f, 0.4375f, 0.5f, 0.5625f, 0.625f, 0.6875f, 0.75f, 0.8125f, 0.875f, 0.9375f, 1.f },
+        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0.5f, 0.5f },
+        { LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL },
+        { RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL },
+        { -1.f, 1.f, -1.f, 1.f, -1.f, 1.f, -1.f, 1.f, -1.f, 1.f, -1.f, 1.f, -1.f, 1.f, -1.f, 1.f },
+    },
+    // Powers of the golden ratio
+    {
+        6,
+        { 0.09f, 0.146f, 0.236f, 0.382f, 0.618f, 1.f },
+        { 0, 0, 0.25f, 0.25f, 0.4f, 0.4f },
+        { LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL },
+        { LEFT_CHANNEL, RIGHT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL },
+        { -0.2f, 0.4f, -0.6f, 0.8f, -1.f, 1.f },
+    },
+    // Dotted 16ths and the bar
+    {
+        6,
+        { 0.1875f, 0.375f, 0.5625f, 0.75f, 0.9375f, 1.f },
+        { 0, 0, 0, 0.45f, 0.45f, 0 },
+        { LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL },
+        { LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, RIGHT_CHANNEL },
+        { -1.f, 1.f, -0.5f, 0.5f, -0.2f, 0.2f },
+    },
+    // Swung 8ths
+    {
+        8,
+        { 0.1667f, 0.25f, 0.4167f, 0.5f, 0.6667f, 0.75f, 0.9167f, 1.f },
+        { 0, 0, 0, 0.45f, 0.2f, 0, 0, 0.45f },
+        { LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL },
+        { LEFT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL, RIGHT_CHANNEL, LEFT_CHANNEL, RIGHT_CHANNEL },
+        { -0.7f, 0.7f, -0.7f, 0.7f, -0.7f, 0.7f, -0.7f, 0.7f },
+    },
+};
 
 constexpr int32_t kAmbienceBufferSize = 48000;
 constexpr int kAmbienceNofDiffusers = 4;
@@ -211,6 +318,8 @@ struct PatchCtrls
     float oscDetuneModAmount;
     float oscDetuneCvAmount;
     float oscUseWavetable;
+    float oscSineMode;
+    float oscVoices;
 
     float filterVol;
     float filterMode;
@@ -231,6 +340,7 @@ struct PatchCtrls
     float resonatorFeedbackModAmount;
     float resonatorFeedbackCvAmount;
     float resonatorDissonance;
+    float resonatorModel;
 
     float echoVol;
     float echoRepeats;
@@ -240,6 +350,7 @@ struct PatchCtrls
     float echoDensityModAmount;
     float echoDensityCvAmount;
     float echoFilter;
+    float echoPattern;
 
     float ambienceVol;
     float ambienceDecay;
@@ -300,6 +411,8 @@ enum StartupPhase
     STARTUP_DONE,
 };
 
+class LooperWav;
+
 struct PatchState
 {
     float sampleRate;
@@ -315,6 +428,8 @@ struct PatchState
     ClockSource clockSource;
     TapTempo* tempo;
 
+    LooperWav* looperWav;
+
     bool syncIn;
     bool clockReset;
     bool clockTick;
@@ -609,6 +724,57 @@ inline float Db2A(float db)
     return Power(10.f, db / 20.f);
 }
 
+// 2^x over an octave, in kExp2TableSize segments.
+static const float kExp2Table[kExp2TableSize + 1] = {
+    1.f, 1.0218971f, 1.0442738f, 1.0671404f, 1.0905077f, 1.1143867f, 1.1387886f, 1.1637249f,
+    1.1892071f, 1.2152474f, 1.2418578f, 1.269051f, 1.2968396f, 1.3252366f, 1.3542555f, 1.3839099f,
+    1.4142136f, 1.4451808f, 1.4768261f, 1.5091644f, 1.5422108f, 1.5759808f, 1.6104903f, 1.6457555f,
+    1.6817928f, 1.7186193f, 1.7562522f, 1.7947091f, 1.8340081f, 1.8741676f, 1.9152066f, 1.9571441f,
+    2.f,
+};
+
+/**
+ * @brief 2^x from a linearly interpolated table, the octave is added to the
+ *        exponent of the result. The error is below 0.006% (0.1 cents).
+ *
+ * @param x -126 to 127
+ */
+inline float FastExp2(float x)
+{
+    // Keep the exponent in the range of normal floats.
+    x = Clamp(x, -126.f, 127.f);
+    float fl = floorf(x);
+    float p = (x - fl) * kExp2TableSize;
+    // The fraction rounds to 1 for tiny negative values.
+    int i = int(p);
+    if (i >= kExp2TableSize)
+    {
+        i = kExp2TableSize - 1;
+    }
+    union
+    {
+        float f;
+        uint32_t i;
+    } u;
+    u.f = kExp2Table[i] + (kExp2Table[i + 1] - kExp2Table[i]) * (p - i);
+    // The table is in [1, 2], whose biased exponent is 127.
+    u.i += (uint32_t(int32_t(fl) + 127) << 23) - (127U << 23);
+
+    return u.f;
+}
+
+// Db2A with FastExp2, 20 / log2(10) dB per octave.
+inline float FastDb2A(float db)
+{
+    return FastExp2(db * 0.16609640f);
+}
+
+// M2F with FastExp2.
+inline float FastM2F(float m)
+{
+    return FastExp2((m - kA4Note) * (1.f / kSemi4Oct)) * kA4Freq;
+}
+
 inline float LinearCrossFade(float a, float b, float pos)
 {
     return a * (1.f - pos) + b * pos;
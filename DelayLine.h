@@ -75,6 +75,32 @@ public:
         return v * (1.f - x) + read(index2) * x;
     }
 
+    // Reads a number of taps at once, so that taps of the same signal can
+    // share a single line.
+    inline void read(const float* indexes, float* outs, size_t taps)
+    {
+        for (size_t t = 0; t < taps; t++)
+        {
+            outs[t] = read(indexes[t]);
+        }
+    }
+
+    // Crossfades each tap between two times, see read(index1, index2, x).
+    inline void read(const float* indexes1, const float* indexes2, float x, float* outs, size_t taps)
+    {
+        if (x == 0)
+        {
+            read(indexes1, outs, taps);
+
+            return;
+        }
+
+        for (size_t t = 0; t < taps; t++)
+        {
+            outs[t] = read(indexes1[t], indexes2[t], x);
+        }
+    }
+
     inline void write(float value, int stride = 1)
     {
         buffer_[writeIndex_] = value;
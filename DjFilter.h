@@ -120,6 +120,45 @@ public:
         rightOut = Clamp(rightOut, -3.f, 3.f);
     }
 
+    // Block version of the per-sample Process, without makeup gain. Input and
+    // output must not overlap.
+    void Process(FloatArray leftIn, FloatArray rightIn, FloatArray leftOut, FloatArray rightOut)
+    {
+        size_t size = leftOut.getSize();
+
+        float mix;
+        switch (filter_)
+        {
+        case FilterType::LP:
+            lpfs_[LEFT_CHANNEL]->process(leftIn, leftOut);
+            lpfs_[RIGHT_CHANNEL]->process(rightIn, rightOut);
+            mix = lpfMix_;
+            break;
+        case FilterType::HP:
+            hpfs_[LEFT_CHANNEL]->process(leftIn, leftOut);
+            hpfs_[RIGHT_CHANNEL]->process(rightIn, rightOut);
+            mix = 1.f - hpfMix_;
+            break;
+        default:
+            leftOut.copyFrom(leftIn);
+            rightOut.copyFrom(rightIn);
+            mix = 0.f;
+            break;
+        }
+
+        // out = filtered * (1 - mix) + in * mix
+        float* li = leftIn.getData();
+        float* ri = rightIn.getData();
+        float* lo = leftOut.getData();
+        float* ro = rightOut.getData();
+        float wet = 1.f - mix;
+        for (size_t i = 0; i < size; i++)
+        {
+            lo[i] = Clamp(lo[i] * wet + li[i] * mix, -3.f, 3.f);
+            ro[i] = Clamp(ro[i] * wet + ri[i] * mix, -3.f, 3.f);
+        }
+    }
+
     void Process(AudioBuffer &input, AudioBuffer &output)
     {
         size_t size = output.getSize();
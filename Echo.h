@@ -4,19 +4,10 @@
 #include "DelayLine.h"
 #include "EnvFollower.h"
 #include "SineOscillator.h"
-#include "ParameterInterpolator.h"
 #include "DjFilter.h"
 #include "Compressor.h"
 #include <stdint.h>
 
-enum EchoTap
-{
-    TAP_LEFT_A,
-    TAP_LEFT_B,
-    TAP_RIGHT_A,
-    TAP_RIGHT_B,
-};
-
 class Echo
 {
 private:
@@ -24,27 +15,52 @@ private:
     PatchCvs* patchCvs_;
     PatchState* patchState_;
 
-    DelayLine* lines_[kEchoTaps];
+    // One line per channel, read by all its taps.
+    DelayLine* lines_[2];
     DjFilter* filter_;
     EnvFollower* ef_[2];
     Compressor* comp_[2];
 
     HysteresisQuantizer densityQuantizer_;
+    HysteresisQuantizer patternQuantizer_;
 
     int clockRatiosIndex_;
-    float echoDensity_, oldDensity_;
-
-    float levels_[kEchoTaps], outs_[kEchoTaps];
-    float tapsTimes_[kEchoTaps], newTapsTimes_[kEchoTaps], maxTapsTimes_[kEchoTaps];
+    float echoDensity_, densityTime_;
+
+    // Taps of the pattern, those reading the left line first.
+    size_t taps_, leftTaps_;
+    float ratios_[kEchoMaxTaps], feedbacks_[kEchoMaxTaps];
+    int destinations_[kEchoMaxTaps];
+    float gainsLeft_[kEchoMaxTaps], gainsRight_[kEchoMaxTaps];
+
+    float levels_[kEchoMaxTaps], outs_[kEchoMaxTaps];
+
+    // Taps of the previous pattern, faded out after a change.
+    EchoPattern pattern_;
+    size_t prevTaps_, prevLeftTaps_;
+    int prevDestinations_[kEchoMaxTaps];
+    float prevGainsLeft_[kEchoMaxTaps], prevGainsRight_[kEchoMaxTaps];
+    float prevLevels_[kEchoMaxTaps], prevOuts_[kEchoMaxTaps];
+    float prevTimes_[kEchoMaxTaps];
+    float patternFade_;
+
+    float tapsTimes_[kEchoMaxTaps], newTapsTimes_[kEchoMaxTaps], maxTapsTimes_[kEchoMaxTaps];
+    float targetTapsTimes_[kEchoMaxTaps];
     float repeats_, filterValue_;
     float xi_;
 
     bool externalClock_;
     bool infinite_;
 
+    inline float ClampTapTime(int idx, float time)
+    {
+        return Clamp(time, kEchoMinLengthSamples * ratios_[idx], (kEchoMaxLengthSamples - 1) * ratios_[idx]);
+    }
+
     void SetTapTime(int idx, float time)
     {
-        newTapsTimes_[idx] = Clamp(time, kEchoMinLengthSamples * kEchoTapsRatios[idx], (kEchoMaxLengthSamples - 1) * kEchoTapsRatios[idx]);
+        newTapsTimes_[idx] = ClampTapTime(idx, time);
+        targetTapsTimes_[idx] = newTapsTimes_[idx];
     }
 
     void SetMaxTapTime(int idx, float time)
@@ -83,10 +99,10 @@ private:
             r = 1.f;
         }
 
-        SetLevel(TAP_LEFT_A, r * kEchoTapsFeedbacks[TAP_LEFT_A]);
-        SetLevel(TAP_LEFT_B, r * kEchoTapsFeedbacks[TAP_LEFT_B]);
-        SetLevel(TAP_RIGHT_A, r * kEchoTapsFeedbacks[TAP_RIGHT_A]);
-        SetLevel(TAP_RIGHT_B, r * kEchoTapsFeedbacks[TAP_RIGHT_B]);
+        for (size_t i = 0; i < taps_; i++)
+        {
+            SetLevel(i, r * feedbacks_[i]);
+        }
 
         float thrs = Map(repeats_, 0.f, 1.f, kEchoCompThresMin, kEchoCompThresMax);
         comp_[LEFT_CHANNEL]->setThreshold(thrs);
@@ -105,9 +121,10 @@ private:
             clockRatiosIndex_ = newIndex;
 
             float d = kModClockRatios[clockRatiosIndex_] * patchState_->clockSamples * kEchoExternalClockMultiplier;
-            for (size_t i = 0; i < kEchoTaps; i++)
+            densityTime_ = d;
+            for (size_t i = 0; i < taps_; i++)
             {
-                SetTapTime(i, d * kEchoTapsRatios[i]);
+                SetTapTime(i, d * ratios_[i]);
             }
 
             // Reset max tap time the next time (...) the clock switches to internal.
@@ -121,22 +138,21 @@ private:
             if (externalClock_)
             {
                 int32_t t = kEchoMaxLengthSamples - 1;
-                for (size_t i = 0; i < kEchoTaps; i++)
+                for (size_t i = 0; i < taps_; i++)
                 {
-                    SetMaxTapTime(i, t * kEchoTapsRatios[i]);
+                    SetMaxTapTime(i, t * ratios_[i]);
                 }
                 externalClock_ = false;
             }
 
             echoDensity_ = value;
 
+            // The tap times glide to these in the read loop.
             float d = MapExpo(echoDensity_, 0.f, 1.f, kEchoMinLengthSamples, patchState_->clockSamples * kEchoInternalClockMultiplier);
-            size_t s = kEchoFadeSamples;
-            ParameterInterpolator densityParam(&oldDensity_, d, s);
-
-            for (size_t i = 0; i < kEchoTaps; i++)
+            densityTime_ = d;
+            for (size_t i = 0; i < taps_; i++)
             {
-                SetTapTime(i, densityParam.Next() * kEchoTapsRatios[i]);
+                targetTapsTimes_[i] = ClampTapTime(i, d * ratios_[i]);
             }
         }
     }
@@ -148,18 +164,20 @@ public:
         patchCvs_ = patchCvs;
         patchState_ = patchState;
 
-        for (size_t i = 0; i < kEchoTaps; i++)
+        for (size_t i = 0; i < 2; i++)
         {
             lines_[i] = DelayLine::create(kEchoMaxLengthSamples);
-            tapsTimes_[i] = kEchoMaxLengthSamples - 1;
-            SetMaxTapTime(i, tapsTimes_[i] * kEchoTapsRatios[i]);
-            levels_[i] = 0;
-            outs_[i] = 0;
         }
 
         echoDensity_ = 1.f;
+        densityTime_ = kEchoMaxLengthSamples - 1;
         clockRatiosIndex_ = 0;
 
+        prevTaps_ = 0;
+        prevLeftTaps_ = 0;
+        patternFade_ = 1.f;
+        SetPattern(ECHO_PATTERN_DEFAULT);
+
         xi_ = 1.f / patchState_->blockSize;
 
         externalClock_ = false;
@@ -175,10 +193,11 @@ public:
         }
 
         densityQuantizer_.Init(kClockUnityRatioIndex, 0.15f, false);
+        patternQuantizer_.Init(ECHO_PATTERN_NOF_PATTERNS, 0.15f, false);
     }
     ~Echo()
     {
-        for (size_t i = 0; i < kEchoTaps; i++)
+        for (size_t i = 0; i < 2; i++)
         {
             DelayLine::destroy(lines_[i]);
         }
@@ -200,6 +219,68 @@ public:
         delete obj;
     }
 
+    /**
+     * @brief Sets the taps from a preset. The taps start at the current echo
+     *        time, without gliding. With fade the taps of the previous
+     *        pattern keep playing and are crossfaded with the new ones over
+     *        kEchoFadeSamples.
+     */
+    void SetPattern(EchoPattern pattern, bool fade = false)
+    {
+        const EchoTapPattern &p = kEchoTapPatterns[pattern];
+
+        pattern_ = pattern;
+        if (fade)
+        {
+            prevTaps_ = taps_;
+            prevLeftTaps_ = leftTaps_;
+            for (size_t i = 0; i < taps_; i++)
+            {
+                prevDestinations_[i] = destinations_[i];
+                prevGainsLeft_[i] = gainsLeft_[i];
+                prevGainsRight_[i] = gainsRight_[i];
+                prevLevels_[i] = levels_[i];
+                prevTimes_[i] = externalClock_ ? tapsTimes_[i] : newTapsTimes_[i];
+            }
+            patternFade_ = 0;
+        }
+
+        taps_ = 0;
+        for (int c = 0; c < 2; c++)
+        {
+            for (size_t i = 0; i < p.taps; i++)
+            {
+                if (p.sources[i] != c)
+                {
+                    continue;
+                }
+                ratios_[taps_] = p.ratios[i];
+                feedbacks_[taps_] = p.feedbacks[i];
+                destinations_[taps_] = p.destinations[i];
+                // Equal power.
+                float angle = (p.pans[i] + 1.f) * M_PI * 0.25f;
+                gainsLeft_[taps_] = cosf(angle);
+                gainsRight_[taps_] = sinf(angle);
+                taps_++;
+            }
+            if (LEFT_CHANNEL == c)
+            {
+                leftTaps_ = taps_;
+            }
+        }
+
+        // Same as Mix2 for two taps per channel.
+        float norm = sqrtf(2.f / taps_);
+        for (size_t i = 0; i < taps_; i++)
+        {
+            gainsLeft_[i] *= norm;
+            gainsRight_[i] *= norm;
+            maxTapsTimes_[i] = (kEchoMaxLengthSamples - 1) * ratios_[i];
+            SetTapTime(i, densityTime_ * ratios_[i]);
+            tapsTimes_[i] = newTapsTimes_[i];
+        }
+    }
+
     void process(AudioBuffer &input, AudioBuffer &output)
     {
         size_t size = output.getSize();
@@ -210,12 +291,16 @@ public:
 
         SetFilter(patchCtrls_->echoFilter);
 
-        float d = Modulate(patchCtrls_->echoDensity, patchCtrls_->echoDensityModAmount, patchState_->modValue, patchCtrls_->echoDensityCvAmount, patchCvs_->echoDensity, -1.f, 1.f, patchState_->modAttenuverters, patchState_->cvAttenuverters);
-        if (externalClock_)
+        // A new pattern waits for the previous change to fade.
+        EchoPattern pattern = EchoPattern(patternQuantizer_.Process(patchCtrls_->echoPattern));
+        if (pattern != pattern_ && patternFade_ >= 1.f)
         {
-            SetDensity(d);
+            SetPattern(pattern, true);
         }
 
+        float d = Modulate(patchCtrls_->echoDensity, patchCtrls_->echoDensityModAmount, patchState_->modValue, patchCtrls_->echoDensityCvAmount, patchCvs_->echoDensity, -1.f, 1.f, patchState_->modAttenuverters, patchState_->cvAttenuverters);
+        SetDensity(d);
+
         float r = Modulate(patchCtrls_->echoRepeats, patchCtrls_->echoRepeatsModAmount, patchState_->modValue, patchCtrls_->echoRepeatsCvAmount, patchCvs_->echoRepeats, -1.f, 1.f, patchState_->modAttenuverters, patchState_->cvAttenuverters);
         SetRepeats(r);
 
@@ -225,6 +310,7 @@ public:
         }
 
         float x = 0;
+        size_t rightTaps = taps_ - leftTaps_;
 
         for (int i = 0; i < size; i++)
         {
@@ -233,24 +319,57 @@ public:
             // internal (for pitch shifting effect).
             if (externalClock_)
             {
-                outs_[TAP_LEFT_A] = lines_[TAP_LEFT_A]->read(tapsTimes_[TAP_LEFT_A], newTapsTimes_[TAP_LEFT_A], x); // A
-                outs_[TAP_LEFT_B] = lines_[TAP_LEFT_B]->read(tapsTimes_[TAP_LEFT_B], newTapsTimes_[TAP_LEFT_B], x); // B
-                outs_[TAP_RIGHT_A] = lines_[TAP_RIGHT_A]->read(tapsTimes_[TAP_RIGHT_A], newTapsTimes_[TAP_RIGHT_A], x); // A
-                outs_[TAP_RIGHT_B] = lines_[TAP_RIGHT_B]->read(tapsTimes_[TAP_RIGHT_B], newTapsTimes_[TAP_RIGHT_B], x); // B
+                lines_[LEFT_CHANNEL]->read(tapsTimes_, newTapsTimes_, x, outs_, leftTaps_);
+                lines_[RIGHT_CHANNEL]->read(tapsTimes_ + leftTaps_, newTapsTimes_ + leftTaps_, x, outs_ + leftTaps_, rightTaps);
 
                 x += xi_;
             }
             else
             {
-                SetDensity(d);
-                outs_[TAP_LEFT_A] = lines_[TAP_LEFT_A]->read(newTapsTimes_[TAP_LEFT_A]); // A
-                outs_[TAP_LEFT_B] = lines_[TAP_LEFT_B]->read(newTapsTimes_[TAP_LEFT_B]); // B
-                outs_[TAP_RIGHT_A] = lines_[TAP_RIGHT_A]->read(newTapsTimes_[TAP_RIGHT_A]); // A
-                outs_[TAP_RIGHT_B] = lines_[TAP_RIGHT_B]->read(newTapsTimes_[TAP_RIGHT_B]); // B
+                for (size_t j = 0; j < taps_; j++)
+                {
+                    newTapsTimes_[j] += (targetTapsTimes_[j] - newTapsTimes_[j]) * kEchoDensitySmoothing;
+                }
+                lines_[LEFT_CHANNEL]->read(newTapsTimes_, outs_, leftTaps_);
+                lines_[RIGHT_CHANNEL]->read(newTapsTimes_ + leftTaps_, outs_ + leftTaps_, rightTaps);
             }
 
-            float leftFb = HardClip(outs_[TAP_LEFT_A] * levels_[TAP_LEFT_A] + outs_[TAP_RIGHT_A] * levels_[TAP_RIGHT_A]);
-            float rightFb = HardClip(outs_[TAP_LEFT_B] * levels_[TAP_LEFT_B] + outs_[TAP_RIGHT_B] * levels_[TAP_RIGHT_B]);
+            float fbs[2] = { 0, 0 };
+            float left = 0;
+            float right = 0;
+            for (size_t j = 0; j < taps_; j++)
+            {
+                fbs[destinations_[j]] += outs_[j] * levels_[j];
+                left += outs_[j] * gainsLeft_[j];
+                right += outs_[j] * gainsRight_[j];
+            }
+
+            if (patternFade_ < 1.f)
+            {
+                lines_[LEFT_CHANNEL]->read(prevTimes_, prevOuts_, prevLeftTaps_);
+                lines_[RIGHT_CHANNEL]->read(prevTimes_ + prevLeftTaps_, prevOuts_ + prevLeftTaps_, prevTaps_ - prevLeftTaps_);
+
+                float prevFbs[2] = { 0, 0 };
+                float prevLeft = 0;
+                float prevRight = 0;
+                for (size_t j = 0; j < prevTaps_; j++)
+                {
+                    prevFbs[prevDestinations_[j]] += prevOuts_[j] * prevLevels_[j];
+                    prevLeft += prevOuts_[j] * prevGainsLeft_[j];
+                    prevRight += prevOuts_[j] * prevGainsRight_[j];
+                }
+
+                float y = patternFade_;
+                fbs[LEFT_CHANNEL] = LinearCrossFade(prevFbs[LEFT_CHANNEL], fbs[LEFT_CHANNEL], y);
+                fbs[RIGHT_CHANNEL] = LinearCrossFade(prevFbs[RIGHT_CHANNEL], fbs[RIGHT_CHANNEL], y);
+                left = LinearCrossFade(prevLeft, left, y);
+                right = LinearCrossFade(prevRight, right, y);
+
+                patternFade_ += kEchoPatternFadeInc;
+            }
+
+            float leftFb = HardClip(fbs[LEFT_CHANNEL]);
+            float rightFb = HardClip(fbs[RIGHT_CHANNEL]);
 
             if (infinite_)
             {
@@ -269,13 +388,8 @@ public:
             leftFb += leftFilter;
             rightFb += rightFilter;
 
-            lines_[TAP_LEFT_A]->write(leftFb);
-            lines_[TAP_LEFT_B]->write(leftFb);
-            lines_[TAP_RIGHT_A]->write(rightFb);
-            lines_[TAP_RIGHT_B]->write(rightFb);
-
-            float left = Mix2(outs_[TAP_LEFT_A], outs_[TAP_LEFT_B]);
-            float right = Mix2(outs_[TAP_RIGHT_A], outs_[TAP_RIGHT_B]);
+            lines_[LEFT_CHANNEL]->write(leftFb);
+            lines_[RIGHT_CHANNEL]->write(rightFb);
 
             left = comp_[LEFT_CHANNEL]->process(left) * kEchoMakeupGain;
             right = comp_[RIGHT_CHANNEL]->process(right) * kEchoMakeupGain;
@@ -286,7 +400,7 @@ public:
 
         if (externalClock_)
         {
-            for (size_t j = 0; j < kEchoTaps; j++)
+            for (size_t j = 0; j < taps_; j++)
             {
                 tapsTimes_[j] = newTapsTimes_[j];
             }
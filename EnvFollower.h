@@ -39,4 +39,21 @@ public:
 
         return Clamp(y_);
     }
+
+    // Writes the envelope of the input block into the output block.
+    void process(FloatArray input, FloatArray output)
+    {
+        size_t size = input.getSize();
+        float* in = input.getData();
+        float* out = output.getData();
+        float y = y_;
+        float l = lambda_;
+        float il = 1.0f - lambda_;
+        for (size_t i = 0; i < size; i++)
+        {
+            y = y * l + fabs(HardClip(in[i])) * il;
+            out[i] = Clamp(y);
+        }
+        y_ = y;
+    }
 };
@@ -1,7 +1,6 @@
 #pragma once
 
 #include "Commons.h"
-#include "StateVariableFilter.h"
 #include "ChaosNoise.h"
 #include "DcBlockingFilter.h"
 #include "EnvFollower.h"
@@ -12,6 +11,7 @@ enum FilterMode
     BP,
     HP,
     CF,
+    FM,
 };
 
 enum FilterPosition
@@ -22,22 +22,37 @@ enum FilterPosition
     POSITION_4,
 };
 
+/**
+ * @brief Allpass with a fractional delay: the integer part comes from the
+ *        line and the fraction from a first order Thiran allpass, which
+ *        unlike linear interpolation doesn't dampen the high frequencies.
+ */
 class Allpass
 {
 private:
     FloatArray line_;
-    int s_, w_;
+    int mask_, w_;
+    int n_;
     float d_, c_, sr_;
+    float a_, x1_, y1_;
 
 public:
+    // The size is rounded up to a power of 2.
     Allpass(float sampleRate, int size)
     {
         sr_ = sampleRate;
-        s_ = size;
-        line_ = FloatArray::create(size);
+        int s = 1;
+        while (s < size)
+        {
+            s <<= 1;
+        }
+        mask_ = s - 1;
+        line_ = FloatArray::create(s);
         w_ = 0;
-        d_ = 1.f;
         c_ = 0.7f;
+        x1_ = 0;
+        y1_ = 0;
+        SetDelay(1.5f);
     }
     ~Allpass()
     {
@@ -56,7 +71,11 @@ public:
 
     void SetDelay(float d)
     {
-        d_ = d;
+        // Thiran is close to flat for a fraction between 0.5 and 1.5.
+        d_ = d < 1.5f ? 1.5f : d;
+        n_ = int(d_ - 0.5f);
+        float f = d_ - n_;
+        a_ = (1.f - f) / (1.f + f);
     }
 
     void SetC(float c)
@@ -66,41 +85,21 @@ public:
 
     inline float readAt(int index)
     {
-        int r = w_ - index;
-        if (r < 0)
-        {
-            r += s_;
-        }
-
-        return line_.getElement(r);
+        return line_[(w_ - index) & mask_];
     }
 
     float Process(float in)
     {
-        size_t idx = (size_t)d_;
-        float y0 = readAt(idx);
-        float y1 = readAt(idx + 1);
-        float frac = d_ - idx;
-
-        float out = Interpolator::linear(y0, y1, frac) + (-c_ * in);
-
-        line_.setElement(w_, in + (c_ * out));
-
-        w_ = (w_ + 1) % s_;
+        float x = readAt(n_);
+        float y = a_ * (x - y1_) + x1_;
+        x1_ = x;
+        y1_ = y;
 
-        return out;
-    }
-
-    float ProcessFixed(float in)
-    {
-        float out = 0;
-        float delayedSample = line_.getElement(w_);
+        float out = y + (-c_ * in);
 
-        out += c_ * delayedSample;
-        out += in - c_ * out;
+        line_[w_] = in + (c_ * out);
 
-        line_.setElement(w_, out);
-        w_ = (w_ + 1) % s_;
+        w_ = (w_ + 1) & mask_;
 
         return out;
     }
@@ -109,25 +108,43 @@ public:
 class CombFilter
 {
 private:
-    Allpass* poles_[4];
+    Allpass* poles_[2];
     EnvFollower* ef_;
     float sampleRate_, reso_, out_;
 
+    // The two fixed stages, y[n] = x[n] + c * (1 - c) * y[n - 2] with c = 0.7
+    // (allpasses with a 2 samples line).
+    float fixed_[2][2];
+
+    inline float ProcessFixed(float* z, float in)
+    {
+        float out = in + kFilterCombFixedGain * z[1];
+        z[1] = z[0];
+        z[0] = out;
+
+        return out;
+    }
+
 public:
     CombFilter(float sampleRate)
     {
         sampleRate_ = sampleRate;
-        poles_[0] = Allpass::create(sampleRate, 2); // Fixed
-        poles_[1] = Allpass::create(sampleRate, 9600); // Variable
-        poles_[2] = Allpass::create(sampleRate, 2); // Fixed
-        poles_[3] = Allpass::create(sampleRate, 9600); // Variable
+        // The second one is twice as long as the first.
+        int size = 2 * sampleRate / kFilterCombFreqMin + 2;
+        poles_[0] = Allpass::create(sampleRate, size);
+        poles_[1] = Allpass::create(sampleRate, size);
+        for (size_t i = 0; i < 2; i++)
+        {
+            fixed_[i][0] = 0;
+            fixed_[i][1] = 0;
+        }
         ef_ = EnvFollower::create();
         reso_ = 0;
         out_ = 0;
     }
     ~CombFilter()
     {
-        for (size_t i = 0; i < 4; i++)
+        for (size_t i = 0; i < 2; i++)
         {
             Allpass::destroy(poles_[i]);
         }
@@ -147,10 +164,9 @@ public:
     void SetFrequency(float freq)
     {
         float d = sampleRate_ / freq;
-        //poles_[0]->SetDelay(d);
-        poles_[1]->SetDelay(d);
-        //poles_[2]->SetDelay(d);
-        poles_[3]->SetDelay(d + d);
+        // The feedback adds a sample to the loop.
+        poles_[0]->SetDelay(d - 1.f);
+        poles_[1]->SetDelay(d + d);
     }
 
     void SetResonance(float reso)
@@ -163,10 +179,10 @@ public:
         float i = in + reso_ * out_;
         i *= 1.f - ef_->process(i);
 
-        float o = poles_[0]->ProcessFixed(i);
+        float o = ProcessFixed(fixed_[0], i);
+        o = poles_[0]->Process(o);
+        o = ProcessFixed(fixed_[1], o);
         o = poles_[1]->Process(o);
-        o = poles_[2]->ProcessFixed(o);
-        o = poles_[3]->Process(o);
 
         out_ = o;
 
@@ -174,15 +190,242 @@ public:
     }
 };
 
+/**
+ * @brief Trapezoidal state variable filter (same as StateVariableFilter)
+ *        running both channels with the same coefficients.
+ *        The cutoff is given as g = tan(pi * fc / sr). The output is a mix
+ *        of the low, band and high pass responses, which are all computed
+ *        anyway. Coefficients and mix ramp to the new values sample by
+ *        sample.
+ */
+class StereoStateVariableFilter
+{
+private:
+    float a1_, a2_, a3_;
+    float m0_, m1_, m2_;
+    float da1_, da2_, da3_;
+    float dm0_, dm1_, dm2_;
+    float ic1eq_[2], ic2eq_[2];
+
+public:
+    StereoStateVariableFilter()
+    {
+        for (size_t i = 0; i < 2; i++)
+        {
+            ic1eq_[i] = 0;
+            ic2eq_[i] = 0;
+        }
+        a1_ = 1.f;
+        a2_ = 0;
+        a3_ = 0;
+        m0_ = 0;
+        m1_ = 0;
+        m2_ = 1;
+        Set(1.f, 0.707f, 1.f, 0, 0, 1);
+    }
+    ~StereoStateVariableFilter() {}
+
+    static StereoStateVariableFilter* create()
+    {
+        return new StereoStateVariableFilter();
+    }
+
+    static void destroy(StereoStateVariableFilter* obj)
+    {
+        delete obj;
+    }
+
+    /**
+     * @brief Sets the coefficients to reach by the end of the next size
+     *        samples, with the amount of each response.
+     */
+    void Set(float g, float q, float lp, float bp, float hp, size_t size)
+    {
+        float k = 1.f / q;
+        float a1 = 1.f / (1.f + g * (g + k));
+        float a2 = g * a1;
+        float a3 = g * a2;
+        // hp = v0 - k * v1 - v2, bp = v1, lp = v2
+        float m0 = hp;
+        float m1 = bp - k * hp;
+        float m2 = lp - hp;
+
+        float r = 1.f / size;
+        da1_ = (a1 - a1_) * r;
+        da2_ = (a2 - a2_) * r;
+        da3_ = (a3 - a3_) * r;
+        dm0_ = (m0 - m0_) * r;
+        dm1_ = (m1 - m1_) * r;
+        dm2_ = (m2 - m2_) * r;
+    }
+
+    // Processes a sample per channel in place.
+    inline void Process(float* v0)
+    {
+        a1_ += da1_;
+        a2_ += da2_;
+        a3_ += da3_;
+        m0_ += dm0_;
+        m1_ += dm1_;
+        m2_ += dm2_;
+        for (size_t c = 0; c < 2; c++)
+        {
+            float v3 = v0[c] - ic2eq_[c];
+            float v1 = a1_ * ic1eq_[c] + a2_ * v3;
+            float v2 = ic2eq_[c] + a2_ * ic1eq_[c] + a3_ * v3;
+            ic1eq_[c] = 2.f * v1 - ic1eq_[c];
+            ic2eq_[c] = 2.f * v2 - ic2eq_[c];
+            v0[c] = m0_ * v0[c] + m1_ * v1 + m2_ * v2;
+        }
+    }
+};
+
+// Formants of the vowels A, E, I, O and U (bass voice): frequency, gain and
+// bandwidth.
+static const float kFormantFreqs[5][kFilterFormants] = {
+    { 600, 1040, 2250, 2450, 2750 },
+    { 400, 1620, 2400, 2800, 3100 },
+    { 250, 1750, 2600, 3050, 3340 },
+    { 400, 750, 2400, 2600, 2900 },
+    { 350, 600, 2400, 2675, 2950 },
+};
+static const float kFormantGains[5][kFilterFormants] = {
+    { 1.f, 0.447f, 0.355f, 0.355f, 0.1f },
+    { 1.f, 0.251f, 0.355f, 0.251f, 0.126f },
+    { 1.f, 0.032f, 0.158f, 0.079f, 0.04f },
+    { 1.f, 0.282f, 0.089f, 0.1f, 0.01f },
+    { 1.f, 0.1f, 0.025f, 0.04f, 0.016f },
+};
+static const float kFormantBandwidths[5][kFilterFormants] = {
+    { 60, 70, 110, 120, 130 },
+    { 40, 80, 100, 120, 120 },
+    { 60, 90, 100, 120, 120 },
+    { 40, 80, 100, 120, 120 },
+    { 40, 80, 100, 120, 120 },
+};
+
+/**
+ * @brief Bank of parallel band pass filters (trapezoidal SVFs) tuned to the
+ *        formants of a vowel, morphing from A to U. The coefficients of the
+ *        bands are kept as arrays and shared by both channels, and like the
+ *        state variable filter they ramp to the new values sample by sample.
+ */
+class FormantFilter
+{
+private:
+    float sampleRate_;
+    float a1_[kFilterFormants], a2_[kFilterFormants], a3_[kFilterFormants];
+    float gains_[kFilterFormants];
+    float da1_[kFilterFormants], da2_[kFilterFormants], da3_[kFilterFormants];
+    float dgains_[kFilterFormants];
+    float ic1eq_[2][kFilterFormants], ic2eq_[2][kFilterFormants];
+
+public:
+    FormantFilter(float sampleRate)
+    {
+        sampleRate_ = sampleRate;
+        for (size_t c = 0; c < 2; c++)
+        {
+            for (size_t i = 0; i < kFilterFormants; i++)
+            {
+                ic1eq_[c][i] = 0;
+                ic2eq_[c][i] = 0;
+            }
+        }
+        for (size_t i = 0; i < kFilterFormants; i++)
+        {
+            a1_[i] = 1.f;
+            a2_[i] = 0;
+            a3_[i] = 0;
+            gains_[i] = 0;
+        }
+        SetVowel(0, 1.f, 1);
+    }
+    ~FormantFilter() {}
+
+    static FormantFilter* create(float sampleRate)
+    {
+        return new FormantFilter(sampleRate);
+    }
+
+    static void destroy(FormantFilter* obj)
+    {
+        delete obj;
+    }
+
+    /**
+     * @brief Sets the coefficients to reach by the end of the next size
+     *        samples.
+     * @param vowel From 0 (A) to 1 (U)
+     * @param sharpness Multiplies the Q of the formants
+     */
+    void SetVowel(float vowel, float sharpness, size_t size)
+    {
+        float x = Clamp(vowel) * 4.f;
+        int v = x;
+        if (v > 3)
+        {
+            v = 3;
+        }
+        x -= v;
+
+        float r = 1.f / size;
+        for (size_t i = 0; i < kFilterFormants; i++)
+        {
+            float f = LinearCrossFade(kFormantFreqs[v][i], kFormantFreqs[v + 1][i], x);
+            float bw = LinearCrossFade(kFormantBandwidths[v][i], kFormantBandwidths[v + 1][i], x);
+            float g = tanf(M_PI * f / sampleRate_);
+            // Normalized to unity gain at the center, so k * v1.
+            float k = bw / (f * sharpness);
+            float a1 = 1.f / (1.f + g * (g + k));
+            float a2 = g * a1;
+            float a3 = g * a2;
+            float gain = LinearCrossFade(kFormantGains[v][i], kFormantGains[v + 1][i], x) * k;
+            da1_[i] = (a1 - a1_[i]) * r;
+            da2_[i] = (a2 - a2_[i]) * r;
+            da3_[i] = (a3 - a3_[i]) * r;
+            dgains_[i] = (gain - gains_[i]) * r;
+        }
+    }
+
+    // Processes a sample per channel in place.
+    inline void Process(float* v0)
+    {
+        for (size_t i = 0; i < kFilterFormants; i++)
+        {
+            a1_[i] += da1_[i];
+            a2_[i] += da2_[i];
+            a3_[i] += da3_[i];
+            gains_[i] += dgains_[i];
+        }
+        for (size_t c = 0; c < 2; c++)
+        {
+            float* ic1 = ic1eq_[c];
+            float* ic2 = ic2eq_[c];
+            float out = 0;
+            for (size_t i = 0; i < kFilterFormants; i++)
+            {
+                float v3 = v0[c] - ic2[i];
+                float v1 = a1_[i] * ic1[i] + a2_[i] * v3;
+                float v2 = ic2[i] + a2_[i] * ic1[i] + a3_[i] * v3;
+                ic1[i] = 2.f * v1 - ic1[i];
+                ic2[i] = 2.f * v2 - ic2[i];
+                out += v1 * gains_[i];
+            }
+            v0[c] = out;
+        }
+    }
+};
+
 class Filter
 {
 private:
     PatchCtrls* patchCtrls_;
     PatchCvs* patchCvs_;
     PatchState* patchState_;
-    StateVariableFilter* filters_[2];
+    StereoStateVariableFilter* filter_;
+    FormantFilter* formant_;
     CombFilter* combs_[2];
-    ChaosNoise noise_;
     FilterMode mode_, lastMode_;
     DcBlockingFilter* dc_[2];
     EnvFollower* ef_[2];
@@ -194,21 +437,46 @@ private:
     float filterGain_;
     float dryWet_;
     float noiseLevel_;
+    ChaosNoise* noise_;
     float feedback_;
 
+    // Amounts of low, band and high pass.
+    float morph_[3];
+
+    // tan(pi * fc / sr) for the cutoff knob's range.
+    float gTable_[kFilterCutoffTableSize + 1];
+
+    inline float GetG(float value)
+    {
+        float x = Clamp(value, 0.f, 1.f) * kFilterCutoffTableSize;
+        int i = int(x);
+        if (i >= kFilterCutoffTableSize)
+        {
+            return gTable_[kFilterCutoffTableSize];
+        }
+
+        return gTable_[i] + (gTable_[i + 1] - gTable_[i]) * (x - i);
+    }
+
     void SetMode(float value)
     {
         FilterMode mode;
 
-        if (value >= 0.75f)
+        // Settings saved before the formant mode are rescaled on load, see
+        // Ui::LoadAltParams.
+        if (value >= 0.8f)
+        {
+            mode = FilterMode::FM;
+        }
+        else if (value >= 0.6f)
         {
             mode = FilterMode::CF;
         }
-        else if (value >= 0.5f)
+        else if (value >= 0.4f)
         {
             mode = FilterMode::HP;
         }
-        else if (value >= 0.25f)
+        else if (value >= 0.2f)
         {
             mode = FilterMode::BP;
         }
@@ -217,6 +485,15 @@ private:
             mode = FilterMode::LP;
         }
 
+        // Between the low, band and high pass zones the responses are
+        // crossfaded. The comb and formant filters are still switched.
+        float w = kFilterMorphWidth;
+        float t1 = Clamp((value - (0.2f - w * 0.5f)) / w);
+        float t2 = Clamp((value - (0.4f - w * 0.5f)) / w);
+        morph_[0] = 1.f - t1;
+        morph_[1] = t1 - t2;
+        morph_[2] = t2;
+
         if (mode == mode_)
         {
             return;
@@ -225,50 +502,39 @@ private:
         mode_ = mode;
     }
 
-    void SetFreq(float value)
+    void SetFreq(float value, size_t size)
     {
-        filterGain_ = kFilterLpGainMin;
-
         float cutoff = Clamp(MapLog(value, 0.f, 1.f, 10.f, 22000.f), 10.f, 22000.f);
 
-        switch (mode_)
+        if (FilterMode::FM == mode_)
         {
-        case FilterMode::LP:
-            {
-                filters_[LEFT_CHANNEL]->setLowPass(cutoff, reso_);
-                filters_[RIGHT_CHANNEL]->setLowPass(cutoff, reso_);
-                // Shut the filter off when the frequency is really low.
-                float g = MapExpo(resoValue_, 0.f, 1.f, kFilterLpGainMax, kFilterLpGainMin);
-                filterGain_ = cutoff <= 15.f ? Map(cutoff, 10.f, 15.f, 0.f, g) : g;
-                break;
-            }
-        case FilterMode::BP:
-            {
-                filters_[LEFT_CHANNEL]->setBandPass(cutoff, reso_);
-                filters_[RIGHT_CHANNEL]->setBandPass(cutoff, reso_);
-                filterGain_ = MapExpo(resoValue_, 0.f, 1.f, kFilterBpGainMin, kFilterBpGainMax);
-            }
-            break;
-        case FilterMode::HP:
-            {
-                filters_[LEFT_CHANNEL]->setHighPass(cutoff, reso_);
-                filters_[RIGHT_CHANNEL]->setHighPass(cutoff, reso_);
-                // Shut the filter off when the frequency is really high.
-                float g = MapExpo(resoValue_, 0.f, 1.f, kFilterHpGainMax, kFilterHpGainMin);
-                filterGain_ = cutoff >= 20000.f ? Map(cutoff, 15000, 20000, g, 0.f) : g;
-                break;
-            }
-        case FilterMode::CF:
-            float f = Clamp(Map(value, 0.f, 1.f, 100.f, 15000.f), 100.f, 15000.f);
+            formant_->SetVowel(value, Map(resoValue_, 0.f, 1.f, kFilterFormantSharpnessMin, kFilterFormantSharpnessMax), size);
+            filterGain_ = MapExpo(resoValue_, 0.f, 1.f, kFilterFormantGainMin, kFilterFormantGainMax);
+        }
+        else if (FilterMode::CF != mode_)
+        {
+            filter_->Set(GetG(value), reso_, morph_[0], morph_[1], morph_[2], size);
+
+            // Shut the filter off when the frequency is really low (low
+            // pass) or really high (high pass).
+            float lp = MapExpo(resoValue_, 0.f, 1.f, kFilterLpGainMax, kFilterLpGainMin);
+            lp = cutoff <= 15.f ? Map(cutoff, 10.f, 15.f, 0.f, lp) : lp;
+            float bp = MapExpo(resoValue_, 0.f, 1.f, kFilterBpGainMin, kFilterBpGainMax);
+            float hp = MapExpo(resoValue_, 0.f, 1.f, kFilterHpGainMax, kFilterHpGainMin);
+            hp = cutoff >= 20000.f ? Map(cutoff, 15000, 20000, hp, 0.f) : hp;
+            filterGain_ = lp * morph_[0] + bp * morph_[1] + hp * morph_[2];
+        }
+        else
+        {
+            float f = Clamp(Map(value, 0.f, 1.f, kFilterCombFreqMin, 15000.f), kFilterCombFreqMin, 15000.f);
             float r = Clamp(VariableCrossFade(0.f, 0.8f, resoValue_, 0.9f), 0.f, 0.8f);
             combs_[LEFT_CHANNEL]->SetFrequency(f);
             combs_[LEFT_CHANNEL]->SetResonance(r);
             combs_[RIGHT_CHANNEL]->SetFrequency(f);
             combs_[RIGHT_CHANNEL]->SetResonance(r);
             filterGain_ = MapExpo(resoValue_, 0.f, 1.f, kFilterCombGainMax, kFilterCombGainMin);
-            break;
         }
-        noise_.SetFreq(cutoff);
+        noise_->SetFreq(cutoff);
     }
 
     void SetReso(float value)
@@ -286,26 +552,36 @@ public:
         patchCvs_ = patchCvs;
         patchState_ = patchState;
 
-        noise_.Init(patchState_->sampleRate);
-        noise_.SetChaos(kFilterChaosNoise);
-
+        filter_ = StereoStateVariableFilter::create();
+        formant_ = FormantFilter::create(patchState_->sampleRate);
+        noise_ = ChaosNoise::create(patchState_->sampleRate, patchState_->blockSize);
+        noise_->SetChaos(kFilterChaosNoise);
+        for (int i = 0; i <= kFilterCutoffTableSize; i++)
+        {
+            float cutoff = Clamp(MapLog((float)i / kFilterCutoffTableSize, 0.f, 1.f, 10.f, 22000.f), 10.f, 22000.f);
+            gTable_[i] = tanf(M_PI * cutoff / patchState_->sampleRate);
+        }
         for (size_t i = 0; i < 2; i++)
         {
-            filters_[i] = StateVariableFilter::create(patchState_->sampleRate);
             combs_[i] = CombFilter::create(patchState_->sampleRate);
             dc_[i] = DcBlockingFilter::create();
             ef_[i] = EnvFollower::create();
         }
 
         mode_ = lastMode_ = FilterMode::LP;
+        morph_[0] = 1.f;
+        morph_[1] = 0;
+        morph_[2] = 0;
         freq_ = 22000.f;
         amp_ = Db2A(120);
     }
     ~Filter()
     {
+        StereoStateVariableFilter::destroy(filter_);
+        FormantFilter::destroy(formant_);
+        ChaosNoise::destroy(noise_);
         for (size_t i = 0; i < 2; i++)
         {
-            StateVariableFilter::destroy(filters_[i]);
             CombFilter::destroy(combs_[i]);
             DcBlockingFilter::destroy(dc_[i]);
             EnvFollower::destroy(ef_[i]);
@@ -346,44 +622,60 @@ public:
         SetReso(r);
 
         float c = Modulate(patchCtrls_->filterCutoff, patchCtrls_->filterCutoffModAmount, patchState_->modValue, patchCtrls_->filterCutoffCvAmount, patchCvs_->filterCutoff, -1.f, 1.f, patchState_->modAttenuverters, patchState_->cvAttenuverters);
-        SetFreq(c);
+        SetFreq(c, size);
 
         if (StartupPhase::STARTUP_DONE != patchState_->startupPhase)
         {
             return;
         }
 
+        float* ins[2] = { leftIn.getData(), rightIn.getData() };
+        float* outs[2] = { leftOut.getData(), rightOut.getData() };
+        float vol = patchCtrls_->filterVol;
+        noise_->Generate();
+        float* noise = noise_->GetBlock().getData();
+
         for (size_t i = 0; i < size; i++)
         {
-            float n = noise_.Process() * noiseLevel_;
-
-            float lIn = Clamp(leftIn[i], -3.f, 3.f);
-            float rIn = Clamp(rightIn[i], -3.f, 3.f);
+            float n = noise[i] * noiseLevel_;
 
-            float ls = SoftClip(lIn * amp_ + n);
-            float rs = SoftClip(rIn * amp_ + n);
-
-            float lf = LinearCrossFade(lIn + n, ls, drive_);
-            float rf = LinearCrossFade(rIn + n, rs, drive_);
+            // Drive, both channels together.
+            float in[2];
+            float v[2];
+            for (size_t c = 0; c < 2; c++)
+            {
+                in[c] = Clamp(ins[c][i], -3.f, 3.f);
+                v[c] = LinearCrossFade(in[c] + n, SoftClip(in[c] * amp_ + n), drive_);
+            }
 
-            float lo, ro;
             if (FilterMode::CF == mode_)
             {
-                lo = HardClip(combs_[LEFT_CHANNEL]->Process(lf) * filterGain_);
-                ro = HardClip(combs_[RIGHT_CHANNEL]->Process(rf) * filterGain_);
-                lo = dc_[LEFT_CHANNEL]->process(lo);
-                ro = dc_[RIGHT_CHANNEL]->process(ro);
+                for (size_t c = 0; c < 2; c++)
+                {
+                    v[c] = dc_[c]->process(HardClip(combs_[c]->Process(v[c]) * filterGain_));
+                }
             }
             else
             {
-                lo = filters_[LEFT_CHANNEL]->process(lf) * filterGain_;
-                ro = filters_[RIGHT_CHANNEL]->process(rf) * filterGain_;
-                lo *= 1.f - ef_[LEFT_CHANNEL]->process(lo);
-                ro *= 1.f - ef_[RIGHT_CHANNEL]->process(ro);
+                if (FilterMode::FM == mode_)
+                {
+                    formant_->Process(v);
+                }
+                else
+                {
+                    filter_->Process(v);
+                }
+                for (size_t c = 0; c < 2; c++)
+                {
+                    v[c] *= filterGain_;
+                    v[c] *= 1.f - ef_[c]->process(v[c]);
+                }
             }
 
-            leftOut[i] = CheapEqualPowerCrossFade(lIn, lo * kFilterMakeupGain, patchCtrls_->filterVol);
-            rightOut[i] = CheapEqualPowerCrossFade(rIn, ro * kFilterMakeupGain, patchCtrls_->filterVol);
+            for (size_t c = 0; c < 2; c++)
+            {
+                outs[c][i] = CheapEqualPowerCrossFade(in[c], v[c] * kFilterMakeupGain, vol);
+            }
         }
     }
 };
\ No newline at end of file
@@ -24,6 +24,8 @@ private:
     EnvFollower* ef_[2];
 
     AudioBuffer* sosOut_;
+    AudioBuffer* recordOut_;
+    FloatArray recordEnv_;
 
     PlaybackDirection direction_;
 
@@ -209,6 +211,45 @@ private:
         filter_->SetFilter(value);
     }
 
+    // Sound on sound record kernel, runs the whole block through the filter,
+    // feedback mix, saturation and envelope before writing it.
+    inline void Record(AudioBuffer& input)
+    {
+        size_t size = input.getSize();
+
+        FloatArray left = recordOut_->getSamples(LEFT_CHANNEL);
+        FloatArray right = recordOut_->getSamples(RIGHT_CHANNEL);
+        filter_->Process(input.getSamples(LEFT_CHANNEL), input.getSamples(RIGHT_CHANNEL), left, right);
+
+        float sos = patchCtrls_->looperSos;
+        for (size_t c = 0; c < 2; c++)
+        {
+            float* rec = recordOut_->getSamples(c).getData();
+            float* fb = sosOut_->getSamples(c).getData();
+            float* env = recordEnv_.getData();
+
+            for (size_t i = 0; i < size; i++)
+            {
+                rec[i] = HardClip(fb[i] * sos + rec[i]);
+            }
+
+            ef_[c]->process(recordOut_->getSamples(c), recordEnv_);
+
+            for (size_t i = 0; i < size; i++)
+            {
+                rec[i] *= 1.f - env[i];
+            }
+        }
+
+        // Only advances while recording, as the take might end within the
+        // block.
+        wPhase_ += buffer_->Write(wPhase_, left, right);
+        if (wPhase_ >= kLooperChannelBufferLength)
+        {
+            wPhase_ -= kLooperChannelBufferLength;
+        }
+    }
+
     inline void WriteRead(AudioBuffer& input, AudioBuffer& output)
     {
         size_t size = input.getSize();
@@ -230,28 +271,15 @@ private:
 
         boc_ = false;
 
-        for (size_t i = 0; i < size; i++)
+        // sosOut_ still holds the previous block's output here, which is what
+        // gets fed back.
+        if (buffer_->IsRecording())
         {
-            if (buffer_->IsRecording())
-            {
-                float left, right;
-                filter_->Process(input.getSamples(LEFT_CHANNEL)[i], input.getSamples(RIGHT_CHANNEL)[i], left, right);
-
-                left = HardClip(sosOut_->getSamples(LEFT_CHANNEL)[i] * patchCtrls_->looperSos + left);
-                right = HardClip(sosOut_->getSamples(RIGHT_CHANNEL)[i] * patchCtrls_->looperSos + right);
-
-                left *= 1.f - ef_[LEFT_CHANNEL]->process(left);
-                right *= 1.f - ef_[RIGHT_CHANNEL]->process(right);
-
-                buffer_->Write(wPhase_, left, right);
-
-                wPhase_++;
-                if (wPhase_ >= kLooperChannelBufferLength)
-                {
-                    wPhase_ -= kLooperChannelBufferLength;
-                }
-            }
+            Record(input);
+        }
 
+        for (size_t i = 0; i < size; i++)
+        {
             float left = 0;
             float right = 0;
 
@@ -378,6 +406,8 @@ public:
         buffer_ = LooperBuffer::create();
         filter_ = DjFilter::create(patchState_->sampleRate);
         sosOut_ = AudioBuffer::create(2, patchState_->blockSize);
+        recordOut_ = AudioBuffer::create(2, patchState_->blockSize);
+        recordEnv_ = FloatArray::create(patchState_->blockSize);
         limiter_ = Limiter::create();
 
         direction_ = PlaybackDirection::PLAYBACK_FORWARD;
@@ -418,6 +448,8 @@ public:
         LooperBuffer::destroy(buffer_);
         DjFilter::destroy(filter_);
         AudioBuffer::destroy(sosOut_);
+        AudioBuffer::destroy(recordOut_);
+        FloatArray::destroy(recordEnv_);
         Limiter::destroy(limiter_);
 
         for (size_t i = 0; i < 2; i++)
@@ -441,6 +473,11 @@ public:
         return buffer_->GetBuffer();
     }
 
+    LooperBuffer* GetLooperBuffer()
+    {
+        return buffer_;
+    }
+
     void Process(AudioBuffer &input, AudioBuffer &output)
     {
         input.multiply(patchCtrls_->looperResampling ? kLooperResampleGain : kLooperInputGain);
@@ -2,6 +2,7 @@
 
 #include "Commons.h"
 #include "EnvFollower.h"
+#include "ZeroCrossingIndex.h"
 #include <algorithm>
 
 enum PlaybackDirection
@@ -115,6 +116,69 @@ public:
             buffer_->setElement(position, value);
         }
     }
+
+    /**
+     * @brief Writes a contiguous span of samples. The span must not cross
+     *        the end of the buffer.
+     *
+     * @return The number of samples written, less than size if a fade out
+     *         ends within the span
+     */
+    inline size_t Write(uint32_t position, const float* values, size_t size)
+    {
+        if (WRITE_STATUS_INACTIVE == status_)
+        {
+            return 0;
+        }
+
+        float* out = buffer_->getData() + position;
+        size_t i = 0;
+
+        if (doFade_)
+        {
+            // Fade envelope over the part of the span that is still fading.
+            size_t n = std::min<size_t>(size, kLooperFadeSamples - fadeIndex_);
+            float x = fadeIndex_ * kLooperFadeSamplesR;
+            float dx = kLooperFadeSamplesR;
+            if (WRITE_STATUS_FADE_IN == status_)
+            {
+                x = 1.f - x;
+                dx = -dx;
+            }
+            bool done = fadeIndex_ + n == kLooperFadeSamples;
+            if (done)
+            {
+                // The last sample of the fade is handled below.
+                n--;
+            }
+            for (; i < n; i++)
+            {
+                out[i] = CheapEqualPowerCrossFade(values[i], out[i], x);
+                x += dx;
+            }
+            fadeIndex_ += n;
+            if (done)
+            {
+                x = WRITE_STATUS_FADE_OUT == status_;
+                out[i] = CheapEqualPowerCrossFade(values[i], out[i], x);
+                i++;
+                fadeIndex_++;
+                doFade_ = false;
+                status_ = (WRITE_STATUS_FADE_IN == status_ ? WRITE_STATUS_ACTIVE : WRITE_STATUS_INACTIVE);
+            }
+        }
+
+        if (WRITE_STATUS_INACTIVE == status_)
+        {
+            return i;
+        }
+        if (i < size)
+        {
+            memcpy(out + i, values + i, (size - i) * sizeof(float));
+        }
+
+        return size;
+    }
 };
 
 class LooperBuffer
@@ -126,6 +190,21 @@ private:
 
     WriteHead* writeHeads_[2];
 
+    ZeroCrossingIndex* index_;
+
+    uint32_t dirtyTables_;
+
+    // Flags the wavetables overlapping a span of the channel as changed.
+    inline void MarkDirty(uint32_t i, size_t size)
+    {
+        uint32_t first = i / kWaveTableStepLength;
+        uint32_t last = (i + size - 1) / kWaveTableStepLength;
+        for (uint32_t q = first; q <= last; q++)
+        {
+            dirtyTables_ |= 1UL << (q % kWaveTableNofTables);
+        }
+    }
+
 public:
     LooperBuffer()
     {
@@ -135,6 +214,10 @@ public:
 
         clearBlock_ = buffer_.getData();
 
+        index_ = ZeroCrossingIndex::create(&buffer_);
+
+        dirtyTables_ = 0xFFFFFFFF;
+
         for (size_t i = 0; i < 2; i++)
         {
             writeHeads_[i] = WriteHead::create(&buffer_);
@@ -146,6 +229,7 @@ public:
         {
             WriteHead::destroy(writeHeads_[i]);
         }
+        ZeroCrossingIndex::destroy(index_);
     }
 
     static LooperBuffer* create()
@@ -173,6 +257,7 @@ public:
         }
 
         memset(clearBlock_, 0, kLooperClearBlockTypeSize);
+        MarkDirty((clearBlock_ - buffer_.getData()) % kLooperChannelBufferLength, kLooperClearBlockSize);
         clearBlock_ += kLooperClearBlockSize;
 
         return false;
@@ -180,10 +265,88 @@ public:
 
     inline void Write(uint32_t i, float left, float right)
     {
+        if (IsRecording())
+        {
+            MarkDirty(i % kLooperChannelBufferLength, 1);
+        }
         writeHeads_[LEFT_CHANNEL]->Write(i, left);
         writeHeads_[RIGHT_CHANNEL]->Write(i + kLooperChannelBufferLength, right);
     }
 
+    // Block version, the span is split where it wraps around the end of the
+    // channel. Returns the number of samples written, the write heads stop
+    // within the block when a fade out ends.
+    inline size_t Write(uint32_t i, FloatArray left, FloatArray right)
+    {
+        if (!IsRecording())
+        {
+            return 0;
+        }
+
+        size_t size = left.getSize();
+        size_t n = std::min<size_t>(size, kLooperChannelBufferLength - i);
+
+        // Both heads are in the same state.
+        size_t written = writeHeads_[LEFT_CHANNEL]->Write(i, left.getData(), n);
+        writeHeads_[RIGHT_CHANNEL]->Write(i + kLooperChannelBufferLength, right.getData(), n);
+        if (written == n && n < size)
+        {
+            written += writeHeads_[LEFT_CHANNEL]->Write(0, left.getData() + n, size - n);
+            writeHeads_[RIGHT_CHANNEL]->Write(kLooperChannelBufferLength, right.getData() + n, size - n);
+        }
+
+        // The span written includes the end of the fade out.
+        size_t first = std::min(written, n);
+        if (first > 0)
+        {
+            MarkDirty(i, first);
+            index_->Scan(i, first);
+        }
+        if (written > n)
+        {
+            MarkDirty(0, written - n);
+            index_->Scan(0, written - n);
+        }
+
+        return written;
+    }
+
+    /**
+     * @brief Copies samples straight into the buffer, bypassing the write
+     *        heads. Used for loading external material.
+     */
+    inline void Load(uint32_t i, const float* left, const float* right, size_t size)
+    {
+        memcpy(buffer_.getData() + i, left, size * sizeof(float));
+        memcpy(buffer_.getData() + kLooperChannelBufferLength + i, right, size * sizeof(float));
+        MarkDirty(i, size);
+        if (i == 0)
+        {
+            index_->Reset();
+        }
+        index_->Scan(i, size);
+    }
+
+    /**
+     * @brief Start of a wavetable in the channel, aligned to the audio.
+     */
+    inline int GetTableStart(int table)
+    {
+        return index_->GetTableStart(table);
+    }
+
+    /**
+     * @brief Returns the wavetables that have been written since the last
+     *        call, one bit per table.
+     */
+    inline uint32_t TakeDirtyTables()
+    {
+        uint32_t dirty = dirtyTables_;
+        dirtyTables_ = 0;
+
+        return dirty;
+    }
+
     inline bool IsRecording()
     {
         return writeHeads_[LEFT_CHANNEL]->IsWriting() && writeHeads_[RIGHT_CHANNEL]->IsWriting();
@@ -191,6 +354,7 @@ public:
 
     inline void StartRecording()
     {
+        index_->Reset();
         writeHeads_[LEFT_CHANNEL]->Start();
         writeHeads_[RIGHT_CHANNEL]->Start();
     }
@@ -0,0 +1,311 @@
+#pragma once
+
+#include "Commons.h"
+#include "LooperBuffer.h"
+#include <stdint.h>
+#ifndef __arm__
+#include <stdio.h>
+#endif
+
+/**
+ * @brief Minimal read only file access used by LooperWav. On the device
+ *        files are read from the resource storage, on host builds plain
+ *        files are used.
+ */
+class WavFile
+{
+private:
+#ifdef __arm__
+    Resource* resource_;
+    size_t offset_;
+#else
+    FILE* file_;
+#endif
+
+public:
+    WavFile()
+    {
+#ifdef __arm__
+        resource_ = NULL;
+        offset_ = 0;
+#else
+        file_ = NULL;
+#endif
+    }
+    ~WavFile()
+    {
+        Close();
+    }
+
+    bool OpenRead(const char* name)
+    {
+        Close();
+#ifdef __arm__
+        resource_ = Resource::open(name);
+        offset_ = 0;
+
+        return resource_ != NULL;
+#else
+        file_ = fopen(name, "rb");
+
+        return file_ != NULL;
+#endif
+    }
+
+    void Close()
+    {
+#ifdef __arm__
+        if (resource_)
+        {
+            Resource::destroy(resource_);
+            resource_ = NULL;
+        }
+#else
+        if (file_)
+        {
+            fclose(file_);
+            file_ = NULL;
+        }
+#endif
+    }
+
+    void Seek(size_t offset)
+    {
+#ifdef __arm__
+        offset_ = offset;
+#else
+        fseek(file_, offset, SEEK_SET);
+#endif
+    }
+
+    size_t Read(void* dest, size_t len)
+    {
+#ifdef __arm__
+        size_t n = resource_->read(dest, len, offset_);
+        offset_ += n;
+
+        return n;
+#else
+        return fread(dest, 1, len, file_);
+#endif
+    }
+};
+
+/**
+ * @brief Streams a WAV file into the looper's buffer, a chunk at a time so
+ *        that it can run from the UI poll without blocking the audio.
+ *        Supports 16/24 bit PCM and 32 bit float, mono or stereo. The sample
+ *        rate is not converted.
+ */
+class LooperWav
+{
+private:
+    enum WavState
+    {
+        WAV_STATE_IDLE,
+        WAV_STATE_IMPORTING,
+    };
+
+    enum WavFormat
+    {
+        WAV_FORMAT_PCM = 1,
+        WAV_FORMAT_FLOAT = 3,
+        WAV_FORMAT_EXTENSIBLE = 0xFFFE,
+    };
+
+    LooperBuffer* buffer_;
+    WavFile file_;
+    WavState state_;
+
+    float raw_[kLooperWavChunkFrames * 2]; // Room for a chunk of stereo 32 bit frames
+    float left_[kLooperWavChunkFrames];
+    float right_[kLooperWavChunkFrames];
+
+    uint32_t frame_;
+    uint32_t frames_;
+    uint16_t format_;
+    uint16_t channels_;
+    uint16_t bytes_;
+
+    static inline uint16_t Read16(const uint8_t* p)
+    {
+        return p[0] | (p[1] << 8);
+    }
+
+    static inline uint32_t Read32(const uint8_t* p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    inline float Decode(const uint8_t* p)
+    {
+        if (WAV_FORMAT_FLOAT == format_)
+        {
+            float v;
+            memcpy(&v, p, sizeof(float));
+
+            return v;
+        }
+        if (bytes_ == 2)
+        {
+            return (int16_t)Read16(p) * (1.f / 32768.f);
+        }
+        if (bytes_ == 3)
+        {
+            int32_t v = (int32_t)((p[0] << 8) | (p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8;
+
+            return v * (1.f / 8388608.f);
+        }
+
+        return (int32_t)Read32(p) * (1.f / 2147483648.f);
+    }
+
+    // Finds the format and data chunks and leaves the file at the start of
+    // the samples.
+    bool ReadHeader()
+    {
+        uint8_t h[12];
+        if (file_.Read(h, 12) != 12 || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4))
+        {
+            return false;
+        }
+
+        size_t offset = 12;
+        bool fmt = false;
+        while (file_.Read(h, 8) == 8)
+        {
+            uint32_t size = Read32(h + 4);
+            offset += 8;
+            if (!memcmp(h, "fmt ", 4))
+            {
+                uint8_t f[16];
+                if (size < 16 || file_.Read(f, 16) != 16)
+                {
+                    return false;
+                }
+                format_ = Read16(f);
+                channels_ = Read16(f + 2);
+                bytes_ = Read16(f + 14) / 8;
+                if (WAV_FORMAT_EXTENSIBLE == format_)
+                {
+                    format_ = bytes_ == 4 ? WAV_FORMAT_FLOAT : WAV_FORMAT_PCM;
+                }
+                fmt = true;
+            }
+            else if (!memcmp(h, "data", 4))
+            {
+                if (!fmt || channels_ < 1 || channels_ > 2 || bytes_ < 2 || bytes_ > 4 ||
+                    (WAV_FORMAT_FLOAT == format_ && bytes_ != 4) ||
+                    (WAV_FORMAT_PCM != format_ && WAV_FORMAT_FLOAT != format_))
+                {
+                    return false;
+                }
+                frames_ = std::min<uint32_t>(size / (channels_ * bytes_), kLooperChannelBufferLength);
+                file_.Seek(offset);
+
+                return true;
+            }
+            // Chunks are word aligned.
+            offset += size + (size & 1);
+            file_.Seek(offset);
+        }
+
+        return false;
+    }
+
+    void ImportChunk()
+    {
+        uint32_t n = std::min<uint32_t>(kLooperWavChunkFrames, kLooperChannelBufferLength - frame_);
+        uint32_t frameSize = channels_ * bytes_;
+        uint32_t read = 0;
+
+        if (frame_ < frames_)
+        {
+            read = file_.Read(raw_, std::min<uint32_t>(n, frames_ - frame_) * frameSize) / frameSize;
+        }
+        for (size_t i = 0; i < read; i++)
+        {
+            const uint8_t* p = (uint8_t*)raw_ + i * frameSize;
+            left_[i] = Decode(p);
+            right_[i] = channels_ == 2 ? Decode(p + bytes_) : left_[i];
+        }
+        // Silence after the end of the file.
+        for (size_t i = read; i < n; i++)
+        {
+            left_[i] = 0;
+            right_[i] = 0;
+        }
+
+        buffer_->Load(frame_, left_, right_, n);
+
+        frame_ += n;
+        if (frame_ >= kLooperChannelBufferLength)
+        {
+            file_.Close();
+            state_ = WAV_STATE_IDLE;
+        }
+    }
+
+public:
+    LooperWav(LooperBuffer* buffer)
+    {
+        buffer_ = buffer;
+        state_ = WAV_STATE_IDLE;
+        frame_ = 0;
+        frames_ = 0;
+        format_ = WAV_FORMAT_PCM;
+        channels_ = 2;
+        bytes_ = 2;
+    }
+    ~LooperWav() {}
+
+    static LooperWav* create(LooperBuffer* buffer)
+    {
+        return new LooperWav(buffer);
+    }
+
+    static void destroy(LooperWav* obj)
+    {
+        delete obj;
+    }
+
+    inline bool IsBusy()
+    {
+        return WAV_STATE_IDLE != state_;
+    }
+
+    /**
+     * @brief Starts loading the file into the looper's buffer. The whole
+     *        buffer is replaced, files that are shorter are padded with
+     *        silence and longer ones are truncated.
+     *
+     * @return false if the file can't be found or isn't supported
+     */
+    bool Import(const char* name)
+    {
+        if (IsBusy() || !file_.OpenRead(name))
+        {
+            return false;
+        }
+        if (!ReadHeader())
+        {
+            file_.Close();
+
+            return false;
+        }
+
+        frame_ = 0;
+        state_ = WAV_STATE_IMPORTING;
+
+        return true;
+    }
+
+    // Called at block rate
+    void Process()
+    {
+        if (WAV_STATE_IMPORTING == state_)
+        {
+            ImportChunk();
+        }
+    }
+};
@@ -2,6 +2,7 @@
 
 #include "Commons.h"
 #include "MorphingOscillator.h"
+#include "RampOscillator.h"
 #include "NoiseOscillator.h"
 #include "LorenzAttractor.h"
 #include "EnvelopeFollowerMod.h"
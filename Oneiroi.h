@@ -10,6 +10,7 @@
 #include "Resonator.h"
 #include "Echo.h"
 #include "Looper.h"
+#include "LooperWav.h"
 #include "Schmitt.h"
 #include "TGate.h"
 #include "EnvFollower.h"
@@ -29,18 +30,20 @@ private:
     StereoSuperSaw* saw_;
     StereoWaveTableOscillator* wt_;
     WaveTableBuffer* wtBuffer_;
+    WaveTableCache* wtCache_;
     Filter* filter_;
     Resonator* resonator_;
     Echo* echo_;
     Ambience* ambience_;
     Looper* looper_;
+    LooperWav* looperWav_;
     Limiter* limiter_;
 
     Modulation* modulation_;
 
     AudioBuffer* input_;
     AudioBuffer* resample_;
-    AudioBuffer* osc1Out_;
+    FloatArray osc1Out_;
     AudioBuffer* osc2Out_;
 
     StereoDcBlockingFilter* inputDcFilter_;
@@ -57,8 +60,13 @@ public:
         patchCvs_ = patchCvs;
         patchState_ = patchState;
 
+        // Before anything else, so that it's allocated in the internal RAM.
+        wtCache_ = WaveTableCache::create();
+
         looper_ = Looper::create(patchCtrls_, patchCvs_, patchState_);
-        wtBuffer_ = WaveTableBuffer::create(looper_->GetBuffer());
+        wtBuffer_ = WaveTableBuffer::create(looper_->GetLooperBuffer(), wtCache_);
+        looperWav_ = LooperWav::create(looper_->GetLooperBuffer());
+        patchState_->looperWav = looperWav_;
 
         sine_ = StereoSineOscillator::create(patchCtrls_, patchCvs_, patchState_);
         saw_ = StereoSuperSaw::create(patchCtrls_, patchCvs_, patchState_);
@@ -75,7 +83,7 @@ public:
 
         input_ = AudioBuffer::create(2, patchState_->blockSize);
         resample_ = AudioBuffer::create(2, patchState_->blockSize);
-        osc1Out_ = AudioBuffer::create(2, patchState_->blockSize);
+        osc1Out_ = FloatArray::create(patchState_->blockSize);
         osc2Out_ = AudioBuffer::create(2, patchState_->blockSize);
 
         for (size_t i = 0; i < 2; i++)
@@ -91,10 +99,12 @@ public:
     {
         AudioBuffer::destroy(input_);
         AudioBuffer::destroy(resample_);
-        AudioBuffer::destroy(osc1Out_);
+        FloatArray::destroy(osc1Out_);
         AudioBuffer::destroy(osc2Out_);
         WaveTableBuffer::destroy(wtBuffer_);
+        WaveTableCache::destroy(wtCache_);
         Looper::destroy(looper_);
+        LooperWav::destroy(looperWav_);
         StereoSineOscillator::destroy(sine_);
         StereoSuperSaw::destroy(saw_);
         StereoWaveTableOscillator::destroy(wt_);
@@ -159,9 +169,12 @@ public:
             looper_->Process(buffer, buffer);
         }
         buffer.add(*input_);
+        wtBuffer_->Update();
 
-        sine_->Process(*osc1Out_);
-        buffer.add(*osc1Out_);
+        // Mono, same for both channels.
+        sine_->Process(osc1Out_);
+        left.add(osc1Out_);
+        right.add(osc1Out_);
         patchCtrls_->oscUseWavetable > 0.5f ? wt_->Process(*osc2Out_) : saw_->Process(*osc2Out_);
         buffer.add(*osc2Out_);
 
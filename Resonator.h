@@ -1,75 +1,124 @@
 #pragma once
 
 #include "Commons.h"
-#include "DelayLine.h"
-#include "BiquadFilter.h"
 #include "EnvFollower.h"
-#include "DcBlockingFilter.h"
 
-class Pole
+/**
+ * @brief Bank of up to kResoMaxStrings feedback delay lines, each one with
+ *        a lowpass in the loop, a DC blocker and a limiter for infinite
+ *        feedback. The state of the strings is kept in arrays and their
+ *        buffers share the write position. The buffers of all the strings
+ *        are allocated up front, only the ones in use are processed.
+ */
+class StringBank
 {
+private:
+    FloatArray buffer_;
+    int writeIndex_;
+    size_t strings_;
+
+    float msr_;
+    float pioversr_;
+    float feedback_;
+
+    float notes_[kResoMaxStrings];
+    float delayTimes_[kResoMaxStrings];
+    float outs_[kResoMaxStrings];
+
+    // Lowpass (transposed direct form II, b1 = 2 * b0, b2 = b0).
+    float b0_[kResoMaxStrings];
+    float a1_[kResoMaxStrings];
+    float a2_[kResoMaxStrings];
+    float s1_[kResoMaxStrings];
+    float s2_[kResoMaxStrings];
+
+    float dcX_[kResoMaxStrings];
+    float dcY_[kResoMaxStrings];
+    float envs_[kResoMaxStrings];
+
+    int channels_[kResoMaxStrings];
+    float gainsLeft_[kResoMaxStrings];
+    float gainsRight_[kResoMaxStrings];
+
+    void Reset(size_t s)
+    {
+        memset(buffer_.getData() + s * kResoBufferSize, 0, kResoBufferSize * sizeof(float));
+        outs_[s] = 0;
+        s1_[s] = 0;
+        s2_[s] = 0;
+        dcX_[s] = 0;
+        dcY_[s] = 0;
+        envs_[s] = 0;
+    }
+
 public:
-    Pole(float sampleRate)
+    StringBank(float sampleRate)
     {
-        sampleRate_ = sampleRate;
-        msr_ = sampleRate_ / 1000.f;
+        buffer_ = FloatArray::create(kResoMaxStrings * kResoBufferSize);
+        writeIndex_ = 0;
+        msr_ = sampleRate / 1000.f;
+        pioversr_ = M_PI / sampleRate;
+        feedback_ = 0;
 
-        for (size_t i = 0; i < 2; i++)
+        for (size_t s = 0; s < kResoMaxStrings; s++)
         {
-            delays_[i] = DelayLine::create(kResoBufferSize);
-            lpfs_[i] = BiquadFilter::create(sampleRate_);
-            dc_[i] = DcBlockingFilter::create();
-            ef_[i] = EnvFollower::create();
+            Reset(s);
+            notes_[s] = 0;
+            delayTimes_[s] = 0;
+            b0_[s] = 0;
+            a1_[s] = 0;
+            a2_[s] = 0;
+            channels_[s] = LEFT_CHANNEL;
+            gainsLeft_[s] = 0;
+            gainsRight_[s] = 0;
         }
-
-        reso_ = FilterStage::BUTTERWORTH_Q;
-        offset_ = 0;
-        feedback_ = 0;
-        filter_ = 0;
-        detune_ = 0;
+        strings_ = 0;
     }
-    ~Pole()
+    ~StringBank()
     {
-        for (size_t i = 0; i < 2; i++)
-        {
-            DelayLine::destroy(delays_[i]);
-            BiquadFilter::destroy(lpfs_[i]);
-            DcBlockingFilter::destroy(dc_[i]);
-            EnvFollower::destroy(ef_[i]);
-        }
+        FloatArray::destroy(buffer_);
     }
 
-    static Pole* create(float sampleRate)
+    static StringBank* create(float sampleRate)
     {
-        return new Pole(sampleRate);
+        return new StringBank(sampleRate);
     }
 
-    static void destroy(Pole* pole)
+    static void destroy(StringBank* obj)
     {
-        delete pole;
+        delete obj;
     }
 
-    float GetSemiOffset()
+    // The strings that are enabled start from silence.
+    void SetStrings(size_t strings)
     {
-        return offset_;
+        strings = strings > kResoMaxStrings ? kResoMaxStrings : strings;
+        for (size_t s = strings_; s < strings; s++)
+        {
+            Reset(s);
+        }
+        strings_ = strings;
     }
 
-    /**
-     * @param offset Semitones, -24 to 24
-     */
-    void SetSemiOffset(float offset)
+    // Channel the string is fed from and its levels in the outputs.
+    void SetRouting(size_t s, int channel, float left, float right)
     {
-        offset_ = offset * -0.5f + 17.667f;
-        SetNote();
+        channels_[s] = channel;
+        gainsLeft_[s] = left;
+        gainsRight_[s] = right;
     }
 
-    void SetFilter(float filter)
+    /**
+     * @param note Delay time in dB of milliseconds, see Resonator
+     */
+    inline void SetNote(size_t s, float note)
     {
-        filter_ = filter;
-        SetFreq();
+        notes_[s] = note;
+        delayTimes_[s] = Clamp(msr_ * FastDb2A(note), 0, kResoBufferSize - 2);
     }
 
-    void SetFeedback(float feedback)
+    // Called at block rate, the lowpasses follow the notes from here.
+    void SetDamping(float feedback, float filter, float reso)
     {
         feedback_ = feedback;
 
@@ -82,97 +131,254 @@ public:
         {
             feedback_ = 1.f;
         }
-    }
-
-    void SetDissonance(float detune)
-    {
-        detune_ = detune;
-        SetNote();
-    }
 
-    void SetReso(float reso)
-    {
-        reso_ = reso;
-        SetFreq();
+        float qr = 1.f / reso;
+        for (size_t s = 0; s < strings_; s++)
+        {
+            float k = tanf((FastM2F(notes_[s]) + filter) * pioversr_);
+            float kk = k * k;
+            float norm = 1.f / (1.f + k * qr + kk);
+            b0_[s] = kk * norm;
+            a1_[s] = 2.f * (kk - 1.f) * norm;
+            a2_[s] = (1.f - k * qr + kk) * norm;
+        }
     }
 
-    // Process just one of the two channels.
-    float Process(float in, int channel)
+    inline void Process(float leftIn, float rightIn, float &leftOut, float &rightOut)
     {
-        float out = lpfs_[channel]->process(outs_[channel]) * feedback_;
-
-        float mix = HardClip(dc_[channel]->process(in + out));
+        float ins[2] = { leftIn, rightIn };
+        float* data = buffer_.getData();
+        bool infinite = feedback_ == kResoInfiniteFeedbackLevel;
 
-        // Handle infinite feedback.
-        if (feedback_ == kResoInfiniteFeedbackLevel)
+        float l = 0;
+        float r = 0;
+        for (size_t s = 0; s < strings_; s++)
         {
-            mix *= 1.095f - ef_[channel]->process(mix);
+            float x = outs_[s];
+            float y = b0_[s] * x + s1_[s];
+            s1_[s] = 2.f * b0_[s] * x - a1_[s] * y + s2_[s];
+            s2_[s] = b0_[s] * x - a2_[s] * y;
+            float out = y * feedback_;
+
+            float in = ins[channels_[s]] + out;
+            dcY_[s] = in - dcX_[s] + kResoDcLambda * dcY_[s];
+            dcX_[s] = in;
+            float mix = HardClip(dcY_[s]);
+
+            // Handle infinite feedback.
+            if (infinite)
+            {
+                envs_[s] = envs_[s] * kResoEnvLambda + fabs(mix) * (1.f - kResoEnvLambda);
+                mix *= 1.095f - Clamp(envs_[s]);
+            }
+
+            float* line = data + s * kResoBufferSize;
+            line[writeIndex_] = mix;
+
+            // A delay of 0 is the sample just written.
+            float d = delayTimes_[s];
+            int k = int(d);
+            int i0 = writeIndex_ - k;
+            if (i0 < 0)
+            {
+                i0 += kResoBufferSize;
+            }
+            int i1 = i0 - 1;
+            if (i1 < 0)
+            {
+                i1 += kResoBufferSize;
+            }
+            outs_[s] = line[i0] + (line[i1] - line[i0]) * (d - k);
+
+            l += out * gainsLeft_[s];
+            r += out * gainsRight_[s];
         }
 
-        delays_[channel]->write(mix);
-        outs_[channel] = delays_[channel]->read(delayTimes_[channel]);
+        if (++writeIndex_ == kResoBufferSize)
+        {
+            writeIndex_ = 0;
+        }
 
-        return out;
+        leftOut = l;
+        rightOut = r;
     }
+};
 
-    void Process(float leftIn, float rightIn, float &leftOut, float &rightOut)
-    {
-        leftOut = lpfs_[LEFT_CHANNEL]->process(outs_[LEFT_CHANNEL]) * feedback_;
-        rightOut = lpfs_[RIGHT_CHANNEL]->process(outs_[RIGHT_CHANNEL]) * feedback_;
+enum ResonatorModel
+{
+    RESONATOR_STRINGS,
+    RESONATOR_MODAL,
+};
 
-        float leftMix = HardClip(dc_[LEFT_CHANNEL]->process(leftIn + leftOut));
-        float rightMix = HardClip(dc_[RIGHT_CHANNEL]->process(rightIn + rightOut));
+enum ModalPreset
+{
+    MODAL_BELL,
+    MODAL_PLATE,
+    MODAL_STRING,
+    MODAL_NOF_PRESETS,
+};
 
-        // Handle infinite feedback.
-        if (feedback_ == kResoInfiniteFeedbackLevel)
-        {
-            leftMix *= 1.095f - ef_[LEFT_CHANNEL]->process(leftMix);
-            rightMix *= 1.095f - ef_[RIGHT_CHANNEL]->process(rightMix);
-        }
+// Frequency ratios and levels of the modes of each preset.
+static const float kModalRatios[MODAL_NOF_PRESETS][kResoModes] = {
+    { 0.5f, 1.f, 1.183f, 1.506f, 2.f, 2.514f, 2.662f, 3.011f, 4.166f, 5.433f, 6.796f, 8.215f, 9.717f, 11.3f, 12.95f, 14.66f },
+    { 1.f, 2.043f, 2.957f, 3.781f, 4.f, 5.738f, 6.214f, 6.219f, 7.262f, 8.171f, 9.f, 9.342f, 10.786f, 11.3f, 11.433f, 11.829f },
+    { 1.f, 2.001f, 3.005f, 4.012f, 5.024f, 6.042f, 7.067f, 8.1f, 9.143f, 10.196f, 11.261f, 12.338f, 13.43f, 14.536f, 15.657f, 16.796f },
+};
+static const float kModalLevels[MODAL_NOF_PRESETS][kResoModes] = {
+    { 0.6f, 1.f, 0.8f, 0.5f, 0.9f, 0.4f, 0.35f, 0.3f, 0.25f, 0.2f, 0.15f, 0.12f, 0.1f, 0.08f, 0.06f, 0.05f },
+    { 1.f, 0.8f, 0.7f, 0.6f, 0.6f, 0.5f, 0.45f, 0.45f, 0.4f, 0.35f, 0.3f, 0.3f, 0.25f, 0.2f, 0.2f, 0.2f },
+    { 1.f, 0.5f, 0.333f, 0.25f, 0.2f, 0.167f, 0.143f, 0.125f, 0.111f, 0.1f, 0.091f, 0.083f, 0.077f, 0.071f, 0.067f, 0.063f },
+};
 
-        delays_[LEFT_CHANNEL]->write(leftMix);
-        delays_[RIGHT_CHANNEL]->write(rightMix);
+/**
+ * @brief kResoModes two-pole resonators per channel (two poles, two zeros,
+ *        unity gain at the center), tuned to the ratios of a preset. The
+ *        coefficients and states are kept in arrays, the coefficients ramp
+ *        to the new values sample by sample.
+ */
+class ModalBank
+{
+private:
+    float sampleRate_;
+    ModalPreset preset_;
+
+    float b0_[2][kResoModes];
+    float a1_[2][kResoModes];
+    float a2_[2][kResoModes];
+    float db0_[2][kResoModes];
+    float da1_[2][kResoModes];
+    float da2_[2][kResoModes];
+    float y1_[2][kResoModes];
+    float y2_[2][kResoModes];
+    float x1_[2], x2_[2];
 
-        outs_[LEFT_CHANNEL] = delays_[LEFT_CHANNEL]->read(delayTimes_[LEFT_CHANNEL]);
-        outs_[RIGHT_CHANNEL] = delays_[RIGHT_CHANNEL]->read(delayTimes_[RIGHT_CHANNEL]);
-    }
+public:
+    ModalBank(float sampleRate)
+    {
+        sampleRate_ = sampleRate;
+        preset_ = MODAL_BELL;
 
-private:
-    DelayLine *delays_[2];
-    BiquadFilter *lpfs_[2];
-    EnvFollower *ef_[2];
-    DcBlockingFilter* dc_[2];
-    float delayTimes_[2], outs_[2];
+        for (size_t c = 0; c < 2; c++)
+        {
+            for (size_t m = 0; m < kResoModes; m++)
+            {
+                b0_[c][m] = 0;
+                a1_[c][m] = 0;
+                a2_[c][m] = 0;
+                db0_[c][m] = 0;
+                da1_[c][m] = 0;
+                da2_[c][m] = 0;
+                y1_[c][m] = 0;
+                y2_[c][m] = 0;
+            }
+            x1_[c] = 0;
+            x2_[c] = 0;
+        }
+    }
+    ~ModalBank() {}
 
-    float sampleRate_, msr_;
-    float lf_, rf_;
-    float reso_;
-    float offset_;
-    float feedback_;
-    float filter_;
-    float detune_;
+    static ModalBank* create(float sampleRate)
+    {
+        return new ModalBank(sampleRate);
+    }
 
-    void SetFreq()
+    static void destroy(ModalBank* obj)
     {
-        lpfs_[LEFT_CHANNEL]->setLowPass(M2F(lf_) + filter_, reso_);
-        lpfs_[RIGHT_CHANNEL]->setLowPass(M2F(rf_) + filter_, reso_);
+        delete obj;
     }
 
-    void SetNote()
+    void SetPreset(ModalPreset preset)
     {
-        lf_ = offset_ + detune_;
-        rf_ = offset_ - detune_;
+        preset_ = preset;
+    }
 
-        delayTimes_[LEFT_CHANNEL] = Clamp(msr_ * Db2A(lf_), 0, kResoBufferSize);
-        delayTimes_[RIGHT_CHANNEL] = Clamp(msr_ * Db2A(rf_), 0, kResoBufferSize);
+    /**
+     * @brief Sets the coefficients to reach by the end of the next size
+     *        samples.
+     *
+     * @param freq Frequency of the first mode
+     * @param decay Decay time of the first mode in seconds, higher modes
+     *        decay faster
+     * @param dissonance 0 to 1, stretches the ratios and detunes the
+     *        channels
+     */
+    void Set(float freq, float decay, float dissonance, size_t size)
+    {
+        const float* ratios = kModalRatios[preset_];
+        const float* levels = kModalLevels[preset_];
+        float stretch = 1.f + dissonance * 0.2f;
+        float spread = kResoModalSpread + dissonance * 0.01f;
+        float wr = 2.f * M_PI / sampleRate_;
+        float dr = -6.9078f / (decay * sampleRate_); // ln(0.001)
+        float sr = 1.f / size;
+
+        for (size_t m = 0; m < kResoModes; m++)
+        {
+            float ratio = fast_powf(ratios[m], stretch);
+            float r = fast_expf(dr * (1.f + kResoModalDamping * (ratio - 1.f)));
+            for (size_t c = 0; c < 2; c++)
+            {
+                float f = freq * ratio * (c == LEFT_CHANNEL ? 1.f - spread : 1.f + spread);
+                if (f < sampleRate_ * 0.45f)
+                {
+                    da1_[c][m] = (2.f * r * cosf(f * wr) - a1_[c][m]) * sr;
+                    da2_[c][m] = (r * r - a2_[c][m]) * sr;
+                    db0_[c][m] = ((1.f - r * r) * 0.5f * levels[m] - b0_[c][m]) * sr;
+                }
+                else
+                {
+                    // Fade out the modes above Nyquist.
+                    da1_[c][m] = 0;
+                    da2_[c][m] = 0;
+                    db0_[c][m] = -b0_[c][m] * sr;
+                }
+            }
+        }
+    }
 
-        SetFreq();
+    inline void Process(float leftIn, float rightIn, float &leftOut, float &rightOut)
+    {
+        float ins[2] = { leftIn, rightIn };
+        float outs[2];
+        for (size_t c = 0; c < 2; c++)
+        {
+            float x = ins[c] - x2_[c];
+            x2_[c] = x1_[c];
+            x1_[c] = ins[c];
+
+            float* b0 = b0_[c];
+            float* a1 = a1_[c];
+            float* a2 = a2_[c];
+            float* db0 = db0_[c];
+            float* da1 = da1_[c];
+            float* da2 = da2_[c];
+            float* y1 = y1_[c];
+            float* y2 = y2_[c];
+            float out = 0;
+            for (size_t m = 0; m < kResoModes; m++)
+            {
+                b0[m] += db0[m];
+                a1[m] += da1[m];
+                a2[m] += da2[m];
+                float y = b0[m] * x + a1[m] * y1[m] - a2[m] * y2[m];
+                y2[m] = y1[m];
+                y1[m] = y;
+                out += y;
+            }
+            outs[c] = out;
+        }
+        leftOut = outs[LEFT_CHANNEL] * kResoModalGain;
+        rightOut = outs[RIGHT_CHANNEL] * kResoModalGain;
     }
 };
 
 /**
  * @brief This is taken from my Reaktor ensemble Aerosynth.
  *        https://www.native-instruments.com/de/reaktor-community/reaktor-user-library/entry/show/3431/
+ *        The first pole is a pair of strings, one per channel, the others
+ *        are single strings alternating between left and right. Poles
+ *        beyond the third follow the tuning of the first three, an octave
+ *        higher every three poles.
  *
  */
 class Resonator
@@ -181,7 +387,10 @@ private:
     PatchCtrls* patchCtrls_;
     PatchCvs* patchCvs_;
     PatchState* patchState_;
-    Pole* poles_[3];
+    StringBank* bank_;
+    ModalBank* modal_;
+    ResonatorModel model_;
+    HysteresisQuantizer modelQuantizer_;
 
     EnvFollower *ef_[2];
 
@@ -192,7 +401,33 @@ private:
     float oldTuning_;
     int ranges_[3];
 
-    int task_;
+    size_t poles_;
+    float offsets_[kResoMaxPoles];
+    float detunes_[kResoMaxPoles];
+
+    // Strings of the pole, returns the first one.
+    static inline size_t PoleString(size_t pole)
+    {
+        return pole == 0 ? 0 : pole + 1;
+    }
+
+    void SetNote(size_t pole)
+    {
+        size_t s = PoleString(pole);
+        if (pole == 0)
+        {
+            bank_->SetNote(s, offsets_[0] + detunes_[0]);
+            bank_->SetNote(s + 1, offsets_[0] - detunes_[0]);
+        }
+        else if (pole & 1)
+        {
+            bank_->SetNote(s, offsets_[pole] + detunes_[pole]);
+        }
+        else
+        {
+            bank_->SetNote(s, offsets_[pole] - detunes_[pole]);
+        }
+    }
 
     /**
      * @param idx 0 - 3
@@ -200,49 +435,48 @@ private:
      */
     void SetSemiOffset(int idx, float offset)
     {
-        if (idx == 0)
+        if (idx != 0)
         {
-            poles_[0]->SetSemiOffset(offset);
-        }
-        else if (idx == 1)
-        {
-            poles_[1]->SetSemiOffset(offset + poles_[1]->GetSemiOffset());
-        }
-        else if (idx == 2)
-        {
-            poles_[2]->SetSemiOffset(offset + poles_[2]->GetSemiOffset());
+            offset += offsets_[idx];
         }
+        offsets_[idx] = offset * -0.5f + 17.667f;
+        SetNote(idx);
     }
 
     void SetTune(float value)
     {
         tune_ = value;
 
-        // Spread the updates in time.
-        task_ = (task_ + 1) % 6;
-        if (task_ == 0)
+        // All the poles are retuned every sample.
+        SetSemiOffset(0, Map(tune_, 0.f, 1.f, -24, ranges_[0]));
+
+        if (tune_ < 0.5f)
         {
-            SetSemiOffset(0, Map(tune_, 0.f, 1.f, -24, ranges_[0]));
+            SetSemiOffset(1, Map(tune_, 0.f, 0.5f, -12, ranges_[1]));
         }
-        if (tune_ < 0.5f && task_ == 1)
+        else
         {
-            SetSemiOffset(1, Map(tune_, 0.f, 0.5f, -12, ranges_[1]));
+            SetSemiOffset(1, Map(tune_, 0.5f, 1.f, -12, ranges_[1]));
         }
-        if (tune_ < 0.3f && task_ == 2)
+
+        if (tune_ < 0.3f)
         {
             SetSemiOffset(2, Map(tune_, 0.f, 0.3f, -6, ranges_[2]));
         }
-        if (tune_ >= 0.3f && tune_ < 0.7f && task_ == 3)
+        else if (tune_ < 0.7f)
         {
             SetSemiOffset(2, Map(tune_, 0.3f, 0.7f, -6, ranges_[2]));
         }
-        if (tune_ >= 0.5f && task_ == 4)
+        else
         {
-            SetSemiOffset(1, Map(tune_, 0.5f, 1.f, -12, ranges_[1]));
+            SetSemiOffset(2, Map(tune_, 0.7f, 1.f, -6, ranges_[2]));
         }
-        if (tune_ >= 0.7f && task_ == 5)
+
+        // An octave is -6 dB of delay time.
+        for (size_t i = 3; i < poles_; i++)
         {
-            SetSemiOffset(2, Map(tune_, 0.7f, 1.f, -6, ranges_[2]));
+            offsets_[i] = offsets_[i % 3] - 6.f * (i / 3);
+            SetNote(i);
         }
     }
 
@@ -251,13 +485,10 @@ private:
         float feedback = Map(value, 0.f, 1.f, 0.85f, 1.f);
         float reso = Map(value, 0.f, 1.f, 0.5f, 0.6f);
         float filter = Map(value, 0.f, 1.f, 5000.f, 10000.f);
-        amp_ = Map(value, 0.f, 1.f, kResoGainMax, kResoGainMin) * 0.577f;
-        for (int i = 0; i < 3; i++)
-        {
-            poles_[i]->SetFeedback(feedback);
-            poles_[i]->SetReso(reso);
-            poles_[i]->SetFilter(filter);
-        }
+        // Normalized by the resonators summed in each output.
+        size_t n = RESONATOR_MODAL == model_ ? kResoModes : poles_;
+        amp_ = Map(value, 0.f, 1.f, kResoGainMax, kResoGainMin) / sqrtf(n);
+        bank_->SetDamping(feedback, filter, reso);
     }
 
     /*
@@ -273,9 +504,11 @@ private:
         ranges_[1] = Map(value, 0.f, 1.f, 12, 7);
         ranges_[2] = Map(value, 0.f, 1.f, 6, 13);
 
-        poles_[0]->SetDissonance(value);
-        poles_[1]->SetDissonance(value * 2.f);
-        poles_[2]->SetDissonance(value * 3.f);
+        for (size_t i = 0; i < poles_; i++)
+        {
+            detunes_[i] = value * (i % 3 + 1);
+            SetNote(i);
+        }
     }
 
 public:
@@ -285,30 +518,35 @@ public:
         patchCvs_ = patchCvs;
         patchState_ = patchState;
 
-        for (int i = 0; i < 3; i++)
-        {
-            poles_[i] = Pole::create(patchState_->sampleRate);
-        }
+        bank_ = StringBank::create(patchState_->sampleRate);
+        modal_ = ModalBank::create(patchState_->sampleRate);
+        model_ = RESONATOR_STRINGS;
+        modelQuantizer_.Init(kResoMaxPoles - kResoPoles + 1 + MODAL_NOF_PRESETS, 0.15f, false);
 
         for (size_t i = 0; i < 2; i++)
         {
             ef_[i] = EnvFollower::create();
         }
 
+        for (size_t i = 0; i < kResoMaxPoles; i++)
+        {
+            offsets_[i] = 0;
+            detunes_[i] = 0;
+        }
+
         amp_ = 1.f;
         range_ = 1.f;
-        task_ = 0;
 
+        poles_ = 0;
+        SetPoles(kResoPoles);
         SetDissonance(0);
         SetTune(0);
         SetFeedback(0);
     }
     ~Resonator()
     {
-        for (int i = 0; i < 3; i++)
-        {
-            Pole::destroy(poles_[i]);
-        }
+        StringBank::destroy(bank_);
+        ModalBank::destroy(modal_);
         for (size_t i = 0; i < 2; i++)
         {
             EnvFollower::destroy(ef_[i]);
@@ -325,6 +563,66 @@ public:
         delete obj;
     }
 
+    /**
+     * @brief Sets the number of poles, 1 to kResoMaxPoles. The strings are
+     *        only processed while the strings model is active.
+     */
+    void SetPoles(size_t poles)
+    {
+        poles = poles < 1 ? 1 : (poles > kResoMaxPoles ? kResoMaxPoles : poles);
+        if (poles == poles_)
+        {
+            return;
+        }
+        poles_ = poles;
+        if (RESONATOR_STRINGS == model_)
+        {
+            SetStrings();
+        }
+    }
+
+    void SetStrings()
+    {
+        bank_->SetStrings(poles_ + 1);
+        bank_->SetRouting(0, LEFT_CHANNEL, 1.f, 0.f);
+        bank_->SetRouting(1, RIGHT_CHANNEL, 0.f, 1.f);
+        for (size_t i = 1; i < poles_; i++)
+        {
+            if (i & 1)
+            {
+                bank_->SetRouting(PoleString(i), LEFT_CHANNEL, 0.75f, 0.25f);
+            }
+            else
+            {
+                bank_->SetRouting(PoleString(i), RIGHT_CHANNEL, 0.25f, 0.75f);
+            }
+        }
+    }
+
+    /**
+     * @brief The modal model replaces the strings with a bank of resonant
+     *        filters, tuned from the first pole and decaying according to
+     *        the feedback. The strings are idle meanwhile and start from
+     *        silence when they're back.
+     */
+    void SetModel(ResonatorModel model, ModalPreset preset = MODAL_BELL)
+    {
+        modal_->SetPreset(preset);
+        if (model == model_)
+        {
+            return;
+        }
+        model_ = model;
+        if (RESONATOR_MODAL == model_)
+        {
+            bank_->SetStrings(0);
+        }
+        else
+        {
+            SetStrings();
+        }
+    }
+
     void process(AudioBuffer &input, AudioBuffer &output)
     {
         size_t size = output.getSize();
@@ -333,32 +631,59 @@ public:
         FloatArray leftOut = output.getSamples(LEFT_CHANNEL);
         FloatArray rightOut = output.getSamples(RIGHT_CHANNEL);
 
+        // From the default number of poles up to the maximum, then the
+        // modal presets.
+        size_t model = modelQuantizer_.Process(patchCtrls_->resonatorModel);
+        size_t poleSteps = kResoMaxPoles - kResoPoles + 1;
+        if (model < poleSteps)
+        {
+            SetModel(RESONATOR_STRINGS);
+            SetPoles(kResoPoles + model);
+        }
+        else
+        {
+            SetModel(RESONATOR_MODAL, ModalPreset(model - poleSteps));
+        }
         SetDissonance(patchCtrls_->resonatorDissonance);
 
         float t = Modulate(patchCtrls_->resonatorTune, patchCtrls_->resonatorTuneModAmount, patchState_->modValue, patchCtrls_->resonatorTuneCvAmount, patchCvs_->resonatorTune, -1.f, 1.f, patchState_->modAttenuverters, patchState_->cvAttenuverters);
         ParameterInterpolator tuningParam(&oldTuning_, t, size);
 
+        // The damping follows the notes at the end of the block, the
+        // strings are retuned every sample below.
+        SetTune(t);
+
         float f = Modulate(patchCtrls_->resonatorFeedback, patchCtrls_->resonatorFeedbackModAmount, patchState_->modValue, patchCtrls_->resonatorFeedbackCvAmount, patchCvs_->resonatorFeedback, -1.f, 1.f, patchState_->modAttenuverters, patchState_->cvAttenuverters);
         SetFeedback(f);
 
+        if (RESONATOR_MODAL == model_)
+        {
+            // Tuned from the delay time of the first pole at the end of the
+            // block, the coefficients ramp there sample by sample.
+            float decay = MapExpo(Clamp(f), 0.f, 1.f, kResoModalDecayMin, kResoModalDecayMax);
+            modal_->Set(1000.f / FastDb2A(offsets_[0]), decay, patchCtrls_->resonatorDissonance, size);
+        }
+
         for (size_t i = 0; i < size; i++)
         {
-            SetTune(tuningParam.Next());
+            float tune = tuningParam.Next();
+            if (RESONATOR_STRINGS == model_)
+            {
+                SetTune(tune);
+            }
 
             float lIn = Clamp(leftIn[i], -3.f, 3.f);
             float rIn = Clamp(rightIn[i], -3.f, 3.f);
 
-            float left = poles_[1]->Process(lIn, LEFT_CHANNEL);
-            float right = poles_[2]->Process(rIn, RIGHT_CHANNEL);
-
-            float oLeft = left * 0.75f + right * 0.25f;
-            float oRight = left * 0.25f + right * 0.75f;
-
-            left = 0;
-            right = 0;
-            poles_[0]->Process(lIn, rIn, left, right);
-            oLeft += left;
-            oRight += right;
+            float oLeft, oRight;
+            if (RESONATOR_MODAL == model_)
+            {
+                modal_->Process(lIn, rIn, oLeft, oRight);
+            }
+            else
+            {
+                bank_->Process(lIn, rIn, oLeft, oRight);
+            }
 
             oLeft *= 1.f - ef_[LEFT_CHANNEL]->process(oLeft);
             oRight *= 1.f - ef_[RIGHT_CHANNEL]->process(oRight);
@@ -370,4 +695,4 @@ public:
             rightOut[i] = CheapEqualPowerCrossFade(rIn, oRight * kResoMakeupGain, patchCtrls_->resonatorVol, 1.4f);
         }
     }
-};
\ No newline at end of file
+};
@@ -1,9 +1,28 @@
 #pragma once
 
 #include "Commons.h"
-#include "SineOscillator.h"
 #include "Schmitt.h"
+#include <algorithm>
 
+enum SineMode
+{
+    SINE_MODE_PURE,
+    SINE_MODE_HARMONICS,
+    SINE_MODE_ODD_HARMONICS,
+    SINE_MODE_SUB_OCTAVES,
+    SINE_MODE_LAST,
+};
+
+/**
+ * @brief Two sines, the second one at the unison interval, generated from a
+ *        table a block at a time. The output is mono, it's written once and
+ *        added to both channels.
+ *        Optionally each sine is a stack of up to kOscSineMaxPartials
+ *        harmonics (Chebyshev recurrence) or kOscSineSubOctaves sub-octaves
+ *        (angle doubling from the lowest one). The gains of the partials
+ *        ramp over a block when the mode changes, going through the pure
+ *        sine when switching between harmonics and sub-octaves.
+ */
 class StereoSineOscillator
 {
 private:
@@ -11,18 +30,30 @@ private:
     PatchCvs* patchCvs_;
     PatchState* patchState_;
 
-    SineOscillator* oscs_[2];
+    // One extra point for the interpolation.
+    float table_[kOscSineTableSize + 1];
 
     Schmitt trigger_;
+    HysteresisQuantizer modeQuantizer_;
+
+    float phases_[2];
+    float subPhases_[2];
+    float incs_[2];
+    float sampleRateR_;
 
-    float oldFreqs_[2];
+    SineMode mode_;
+    bool sub_;
+    float gains_[kOscSineMaxPartials];
+    float targetGains_[kOscSineMaxPartials];
+    float pureGains_[kOscSineMaxPartials];
 
     bool fadeOut_, fadeIn_;
     float sine1Volume_, sine2Volume_;
 
-    void FadeOut()
+    // Advances the fade by a block.
+    void FadeOut(size_t size)
     {
-        sine2Volume_ -= kOscSineFadeInc;
+        sine2Volume_ -= kOscSineFadeInc * size;
         if (sine2Volume_ <= 0)
         {
             sine2Volume_ = 0;
@@ -31,9 +62,9 @@ private:
         }
     }
 
-    void FadeIn()
+    void FadeIn(size_t size)
     {
-        sine2Volume_ += kOscSineFadeInc;
+        sine2Volume_ += kOscSineFadeInc * size;
         if (sine2Volume_ >= 0.5f)
         {
             sine2Volume_ = 0.5f;
@@ -41,6 +72,79 @@ private:
         }
     }
 
+    inline float Read(float phase)
+    {
+        float x = phase * kOscSineTableSize;
+        int j = int(x);
+
+        return table_[j] + (table_[j + 1] - table_[j]) * (x - j);
+    }
+
+    // sin((k + 1)x) = 2cos(x)sin(kx) - sin((k - 1)x)
+    inline float Harmonics(float phase, int n)
+    {
+        float q = phase + 0.25f;
+        float c2 = 2.f * Read(q >= 1.f ? q - 1.f : q);
+        float prev = 0;
+        float cur = Read(phase);
+        float sum = cur * gains_[0];
+        for (int k = 1; k < n; k++)
+        {
+            float next = c2 * cur - prev;
+            prev = cur;
+            cur = next;
+            sum += cur * gains_[k];
+        }
+
+        return sum;
+    }
+
+    // sin(2x) = 2sin(x)cos(x), cos(2x) = 1 - 2sin(x)^2
+    inline float SubOctaves(float phase)
+    {
+        float q = phase + 0.25f;
+        float c = Read(q >= 1.f ? q - 1.f : q);
+        float s = Read(phase);
+        float sum = s * gains_[kOscSineSubOctaves - 1];
+        for (int k = kOscSineSubOctaves - 2; k >= 0; k--)
+        {
+            float t = 2.f * s * c;
+            c = 1.f - 2.f * s * s;
+            s = t;
+            sum += s * gains_[k];
+        }
+
+        return sum;
+    }
+
+    // Sub-octaves come from the lowest one, whose phase is kept separately.
+    inline float Generate(float phase, float subPhase, int n)
+    {
+        if (sub_)
+        {
+            return SubOctaves(subPhase);
+        }
+        if (n == 1)
+        {
+            return Read(phase) * gains_[0];
+        }
+
+        return Harmonics(phase, n);
+    }
+
+    static bool IsPure(const float* gains)
+    {
+        for (int k = 1; k < kOscSineMaxPartials; k++)
+        {
+            if (gains[k] != 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
 public:
     StereoSineOscillator(PatchCtrls* patchCtrls, PatchCvs* patchCvs, PatchState* PatchState)
     {
@@ -48,23 +152,34 @@ public:
         patchCvs_ = patchCvs;
         patchState_ = PatchState;
 
+        for (size_t i = 0; i <= kOscSineTableSize; i++)
+        {
+            table_[i] = sinf(2.f * M_PI * i / kOscSineTableSize);
+        }
+
         for (size_t i = 0; i < 2; i++)
         {
-            oscs_[i] = SineOscillator::create(patchState_->sampleRate);
+            phases_[i] = 0;
+            subPhases_[i] = 0;
+            incs_[i] = 0;
         }
+        sampleRateR_ = 1.f / patchState_->sampleRate;
 
         fadeOut_ = false;
         fadeIn_ = false;
         sine1Volume_ = 0.5f;
         sine2Volume_ = 0.5f;
-    }
-    ~StereoSineOscillator()
-    {
-        for (size_t i = 0; i < 2; i++)
+
+        for (int k = 0; k < kOscSineMaxPartials; k++)
         {
-            SineOscillator::destroy(oscs_[i]);
+            pureGains_[k] = k == 0 ? 1.f : 0.f;
+            gains_[k] = pureGains_[k];
         }
+        sub_ = false;
+        modeQuantizer_.Init(SINE_MODE_LAST, 0.15f, false);
+        SetMode(SINE_MODE_PURE, kOscSinePartials, kOscSineTilt);
     }
+    ~StereoSineOscillator() {}
 
     static StereoSineOscillator* create(PatchCtrls* patchCtrls, PatchCvs* patchCvs, PatchState* PatchState)
     {
@@ -76,10 +191,77 @@ public:
         delete obj;
     }
 
-    void Process(AudioBuffer &output)
+    /**
+     * @brief Sets the additive mode, reached over the next blocks. Partial
+     *        k (0 being the fundamental) has a gain of tilt^k, normalized so
+     *        that the stack peaks like a single sine. In odd harmonics mode
+     *        the even ones are muted but count as partials. There are at
+     *        most kOscSineSubOctaves sub-octaves.
+     */
+    void SetMode(SineMode mode, int partials, float tilt)
+    {
+        mode_ = mode;
+        int max = SINE_MODE_SUB_OCTAVES == mode ? kOscSineSubOctaves : kOscSineMaxPartials;
+        partials = SINE_MODE_PURE == mode ? 1 : (partials < 1 ? 1 : (partials > max ? max : partials));
+
+        float g = 1.f;
+        float sum = 0;
+        for (int k = 0; k < kOscSineMaxPartials; k++)
+        {
+            targetGains_[k] = 0;
+            if (k < partials)
+            {
+                targetGains_[k] = (SINE_MODE_ODD_HARMONICS == mode && (k & 1)) ? 0.f : g;
+                sum += targetGains_[k];
+                g *= tilt;
+            }
+        }
+        for (int k = 0; k < partials; k++)
+        {
+            targetGains_[k] /= sum;
+        }
+    }
+
+    void Process(FloatArray output)
     {
         size_t size = output.getSize();
 
+        SineMode mode = SineMode(modeQuantizer_.Process(patchCtrls_->oscSineMode));
+        if (mode != mode_)
+        {
+            SetMode(mode, kOscSinePartials, kOscSineTilt);
+        }
+
+        // The harmonics and the sub-octaves only share the fundamental, so
+        // switching between them fades the other partials out first.
+        float subRate = 1.f / (1 << (kOscSineSubOctaves - 1));
+        const float* goal = targetGains_;
+        bool sub = SINE_MODE_SUB_OCTAVES == mode_;
+        if (sub != sub_)
+        {
+            if (IsPure(gains_))
+            {
+                sub_ = sub;
+                if (sub_)
+                {
+                    // Align the sub-octaves with the fundamental.
+                    subPhases_[0] = phases_[0] * subRate;
+                    subPhases_[1] = phases_[1] * subRate;
+                }
+            }
+            else
+            {
+                goal = pureGains_;
+            }
+        }
+        bool ramp = false;
+        float gainSteps[kOscSineMaxPartials];
+        for (int k = 0; k < kOscSineMaxPartials; k++)
+        {
+            gainSteps[k] = (goal[k] - gains_[k]) / size;
+            ramp |= goal[k] != gains_[k];
+        }
+
         float u;
         if (patchCtrls_->oscUnison < 0)
         {
@@ -93,35 +275,104 @@ public:
         float f[2];
         f[0] = Clamp(patchCtrls_->oscPitch, kOscFreqMin, kOscFreqMax);
         f[1] = Clamp(f[0] * u, kOscFreqMin, kOscFreqMax);
-        ParameterInterpolator freqParams[2] = {ParameterInterpolator(&oldFreqs_[0], f[0], size), ParameterInterpolator(&oldFreqs_[1], f[1], size)};
 
+        // The increments ramp to the new frequencies over the block.
+        float r = 1.f / size;
+        float steps[2];
+        for (size_t j = 0; j < 2; j++)
+        {
+            steps[j] = (f[j] * sampleRateR_ - incs_[j]) * r;
+        }
+
+        // The flag doesn't change during the block.
+        if (trigger_.Process(patchState_->oscUnisonCenterFlag) && !fadeOut_)
+        {
+            fadeOut_ = true;
+        }
+
+        // While fading in the second sine follows the first one.
+        bool locked = !fadeOut_ && fadeIn_;
+
+        float v2 = sine2Volume_;
+        if (fadeOut_)
+        {
+            FadeOut(size);
+        }
+        else if (fadeIn_)
+        {
+            FadeIn(size);
+        }
+        float v2Step = (sine2Volume_ - v2) * r;
+
+        float gain = patchCtrls_->osc1Vol * kOScSineGain;
+        // Harmonics above Nyquist are dropped. The lowest sub-octave runs
+        // at subRate of the frequency.
+        int n = 1;
+        if (!sub_ && (ramp || !IsPure(gains_)))
+        {
+            int limit = patchState_->sampleRate * 0.5f / std::max(f[0], f[1]);
+            n = std::max(1, std::min(kOscSineMaxPartials, limit));
+        }
+
+        float* out = output.getData();
+        float p1 = phases_[0];
+        float p2 = phases_[1];
+        float q1 = subPhases_[0];
+        float q2 = subPhases_[1];
+        float i1 = incs_[0];
+        float i2 = incs_[1];
         for (size_t i = 0; i < size; i++)
         {
-            for (size_t j = 0; j < 2; j++)
+            float s1 = Generate(p1, q1, n);
+            float s2 = s1;
+            if (!locked)
             {
-                oscs_[j]->setFrequency(freqParams[j].Next());
+                s2 = Generate(p2, q2, n);
             }
 
-            if (trigger_.Process(patchState_->oscUnisonCenterFlag) && !fadeOut_)
+            v2 += v2Step;
+            out[i] = (s1 * sine1Volume_ + s2 * v2) * gain;
+
+            if (ramp)
             {
-                fadeOut_ = true;
+                for (int k = 0; k < kOscSineMaxPartials; k++)
+                {
+                    gains_[k] += gainSteps[k];
+                }
             }
-            if (fadeOut_)
+
+            i1 += steps[0];
+            i2 += steps[1];
+            p1 += i1;
+            p2 += i2;
+            if (p1 >= 1.f)
             {
-                FadeOut();
+                p1 -= 1.f;
             }
-            else if (fadeIn_)
+            if (p2 >= 1.f)
             {
-                oscs_[1]->setPhase(oscs_[0]->getPhase());
-                FadeIn();
+                p2 -= 1.f;
             }
-
-            float out = oscs_[0]->generate() * sine1Volume_ + oscs_[1]->generate() * sine2Volume_;
-
-            out *= patchCtrls_->osc1Vol * kOScSineGain;
-
-            output.getSamples(LEFT_CHANNEL).setElement(i, out);
-            output.getSamples(RIGHT_CHANNEL).setElement(i, out);
+            q1 += i1 * subRate;
+            q2 += i2 * subRate;
+            if (q1 >= 1.f)
+            {
+                q1 -= 1.f;
+            }
+            if (q2 >= 1.f)
+            {
+                q2 -= 1.f;
+            }
+        }
+        phases_[0] = p1;
+        phases_[1] = locked ? p1 : p2;
+        subPhases_[0] = q1;
+        subPhases_[1] = locked ? q1 : q2;
+        incs_[0] = i1;
+        incs_[1] = i2;
+        for (int k = 0; k < kOscSineMaxPartials; k++)
+        {
+            gains_[k] = goal[k];
         }
     }
-};
\ No newline at end of file
+};
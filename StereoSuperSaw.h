@@ -1,10 +1,19 @@
 #pragma once
 
 #include "Commons.h"
-#include "RampOscillator.h"
+
+// Detune curves for 7 voices, other counts are interpolated from these.
+static const float kSuperSawDetunes[7] = { -0.11002313f, -0.06288439f, -0.01952356f, 0, 0.01991221f, 0.06216538f, 0.10745242f };
+static const float kSuperSawDetunesMinor[7] = { -0.877538f, -0.66516f, -0.318207f, 0, 0.189207f, 0.498307f, 0.781797f };
 
 /**
- * @brief 7 sawtooth oscillators with detuning and mixing.
+ * @brief 3 to 16 sawtooth oscillators per channel with detuning and mixing.
+ *        The voices of both channels are spread over a single detune curve
+ *        and assigned alternately to the left and the right, so that the
+ *        channels are decorrelated.
+ *        The voices are kept as arrays of phases and increments and are
+ *        antialiased with PolyBLEP. Only the active voices are processed,
+ *        so the cost grows linearly with their number.
  *        Adapted from
  *        https://web.archive.org/web/20110627045129/https://www.nada.kth.se/utbildning/grukth/exjobb/rapportlistor/2010/rapporter10/szabo_adam_10131.pdf
  *
@@ -12,74 +21,102 @@
 class SuperSaw
 {
 private:
-  AntialiasedRampOscillator* oscs_[7];
-  float detunes_[7];
-  float volumes_[7];
-  float oldFreq_;
+  // Even voices are on the left, odd ones on the right.
+  float phases_[kSuperSawMaxVoices * 2];
+  float incs_[kSuperSawMaxVoices * 2];
+  float detunes_[kSuperSawMaxVoices * 2];
+  float volumes_[kSuperSawMaxVoices * 2];
+  float sampleRateR_;
   float detune_;
 
+  size_t voices_; // Both channels
+  size_t fresh_; // First voice that starts at its increment, without ramp
+
+  // Residual that takes the discontinuity out of the ramp.
+  static inline float PolyBlep(float t, float dt)
+  {
+      if (t < dt)
+      {
+          t /= dt;
+
+          return t + t - t * t - 1.f;
+      }
+      else if (t > 1.f - dt)
+      {
+          t = (t - 1.f) / dt;
+
+          return t * t + t + t + 1.f;
+      }
+
+      return 0.f;
+  }
+
 public:
     SuperSaw(float sampleRate)
     {
-        for (size_t i = 0; i < 7; i++)
+        sampleRateR_ = 1.f / sampleRate;
+        for (size_t i = 0; i < kSuperSawMaxVoices * 2; i++)
         {
-            oscs_[i] = AntialiasedRampOscillator::create(sampleRate);
+            // Distinct starting phases, so that the channels don't start
+            // in sync.
+            phases_[i] = i * 0.618034f - int(i * 0.618034f);
+            incs_[i] = 0;
             detunes_[i] = 0;
             volumes_[i] = 0;
         }
         detune_ = 0;
+
+        voices_ = 0;
+        fresh_ = 0;
+        SetVoices(kSuperSawVoices);
     }
-    ~SuperSaw()
-    {
-        for (size_t i = 0; i < 7; i++)
-        {
-            AntialiasedRampOscillator::destroy(oscs_[i]);
-        }
-    }
+    ~SuperSaw() {}
 
-    void SetFreq(float value)
+    // Voices per channel. The added ones start at the frequency of the next
+    // block.
+    void SetVoices(size_t voices)
     {
-        for (size_t i = 0; i < 7; i++)
+        voices = 2 * (voices < kSuperSawMinVoices ? kSuperSawMinVoices : (voices > kSuperSawMaxVoices ? kSuperSawMaxVoices : voices));
+        if (voices > voices_ && voices_ < fresh_)
         {
-            oscs_[i]->setFrequency(value * detunes_[i]);
+            fresh_ = voices_;
         }
+        voices_ = voices;
     }
 
     void SetDetune(float value, bool minor = false)
     {
         detune_ = value * 0.4f;
 
-        if (minor)
-        {
-            detunes_[0] = 1 - detune_ * 0.877538f;
-            detunes_[1] = 1 - detune_ * 0.66516f;
-            detunes_[2] = 1 - detune_ * 0.318207f;
-            detunes_[3] = 1;
-            detunes_[4] = 1 + detune_ * 0.189207f;
-            detunes_[5] = 1 + detune_ * 0.498307f;
-            detunes_[6] = 1 + detune_ * 0.781797f;
-        }
-        else
-        {
-            detunes_[0] = 1 - detune_ * 0.11002313f;
-            detunes_[1] = 1 - detune_ * 0.06288439f;
-            detunes_[2] = 1 - detune_ * 0.01952356f;
-            detunes_[3] = 1;
-            detunes_[4] = 1 + detune_ * 0.01991221f;
-            detunes_[5] = 1 + detune_ * 0.06216538f;
-            detunes_[6] = 1 + detune_ * 0.10745242f;
-        }
+        const float* curve = minor ? kSuperSawDetunesMinor : kSuperSawDetunes;
 
         value = Clamp(value * 0.5f, 0.005f, 0.5f);
 
         float y = -0.73764f * fast_powf(value, 2.f) + 1.2841f * value + 0.044372f;
-        volumes_[0] = y;
-        volumes_[1] = y;
-        volumes_[2] = y;
-        volumes_[3] = -0.55366f * value + 0.99785f;
-        volumes_[4] = y;
-        volumes_[5] = y;
-        volumes_[6] = y;
+        float c = -0.55366f * value + 0.99785f;
+
+        // Each channel gets the power of the original design: the 12 side
+        // voices of both share that of its 6, the two in the middle (one per
+        // channel) get the center's.
+        y *= sqrtf(12.f / (voices_ - 2));
+
+        for (size_t i = 0; i < voices_; i++)
+        {
+            float p = 6.f * i / (voices_ - 1);
+            size_t k = p;
+            float d = k < 6 ? curve[k] + (curve[k + 1] - curve[k]) * (p - k) : curve[6];
+            detunes_[i] = 1 + detune_ * d;
+
+            int m = 2 * (int)i - ((int)voices_ - 1);
+            if (m == 1 || m == -1)
+            {
+                volumes_[i] = c;
+            }
+            else
+            {
+                volumes_[i] = y;
+            }
+        }
     }
 
     static SuperSaw* create(float sampleRate)
@@ -92,22 +129,48 @@ public:
         delete obj;
     }
 
-    void Process(float freq, FloatArray output)
+    void Process(float freq, FloatArray left, FloatArray right)
     {
-        size_t size = output.getSize();
+        size_t size = left.getSize();
 
-        ParameterInterpolator freqParam(&oldFreq_, freq, size);
+        // The increments ramp linearly to the new frequency over the block,
+        // voices that were just added start at it.
+        float steps[kSuperSawMaxVoices * 2];
+        float r = 1.f / size;
+        for (size_t j = 0; j < voices_; j++)
+        {
+            float inc = freq * detunes_[j] * sampleRateR_;
+            if (j >= fresh_)
+            {
+                incs_[j] = inc;
+            }
+            steps[j] = (inc - incs_[j]) * r;
+        }
+        fresh_ = voices_;
 
+        float* outs[2] = { left.getData(), right.getData() };
         for (size_t i = 0; i < size; i++)
         {
-            SetFreq(freqParam.Next());
-            for (size_t j = 0; j < 7; j++)
+            float sums[2] = { 0, 0 };
+            for (size_t j = 0; j < voices_; j++)
             {
-                output[i] += oscs_[j]->generate() * volumes_[j];
+                float inc = incs_[j] + steps[j];
+                float phase = phases_[j];
+                sums[j & 1] += (2.f * phase - 1.f - PolyBlep(phase, inc)) * volumes_[j];
+                phase += inc;
+                if (phase >= 1.f)
+                {
+                    phase -= 1.f;
+                }
+                phases_[j] = phase;
+                incs_[j] = inc;
             }
+            outs[LEFT_CHANNEL][i] += sums[LEFT_CHANNEL];
+            outs[RIGHT_CHANNEL][i] += sums[RIGHT_CHANNEL];
         }
 
-        output.multiply(0.3f * (1.4f - detune_));
+        left.multiply(0.3f * (1.4f - detune_));
+        right.multiply(0.3f * (1.4f - detune_));
     }
 };
 
@@ -117,15 +180,8 @@ private:
     PatchCtrls* patchCtrls_;
     PatchCvs* patchCvs_;
     PatchState* patchState_;
-    SuperSaw* saws_[2];
-
-    void SetDetune(float value, bool minor = false)
-    {
-        for (int i = 0; i < 2; i++)
-        {
-            saws_[i]->SetDetune(value);
-        }
-    }
+    SuperSaw* saw_;
+    HysteresisQuantizer voicesQuantizer_;
 
 public:
     StereoSuperSaw(PatchCtrls* patchCtrls, PatchCvs* patchCvs, PatchState* patchState)
@@ -134,17 +190,12 @@ public:
         patchCvs_ = patchCvs;
         patchState_ = patchState;
 
-        for (int i = 0; i < 2; i++)
-        {
-            saws_[i] = SuperSaw::create(patchState_->sampleRate);
-        }
+        saw_ = SuperSaw::create(patchState_->sampleRate);
+        voicesQuantizer_.Init(kSuperSawMaxVoices - kSuperSawMinVoices + 1, 0.15f, true);
     }
     ~StereoSuperSaw()
     {
-        for (int i = 0; i < 2; i++)
-        {
-            SuperSaw::destroy(saws_[i]);
-        }
+        SuperSaw::destroy(saw_);
     }
 
     static StereoSuperSaw* create(PatchCtrls* patchCtrls, PatchCvs* patchCvs, PatchState* patchState)
@@ -157,6 +208,11 @@ public:
         delete obj;
     }
 
+    void SetVoices(size_t voices)
+    {
+        saw_->SetVoices(voices);
+    }
+
     void Process(AudioBuffer &output)
     {
         float u = patchCtrls_->oscUnison;
@@ -167,11 +223,13 @@ public:
 
         float f = Modulate(patchCtrls_->oscPitch + patchCtrls_->oscPitch * u, patchCtrls_->oscPitchModAmount, patchState_->modValue, 0, 0, kOscFreqMin, kOscFreqMax, patchState_->modAttenuverters, patchState_->cvAttenuverters);
 
+        // kSuperSawVoices at kOscVoicesDefault.
+        saw_->SetVoices(kSuperSawMinVoices + voicesQuantizer_.Process(patchCtrls_->oscVoices));
+
         float d = Modulate(patchCtrls_->oscDetune, patchCtrls_->oscDetuneModAmount, patchState_->modValue, patchCtrls_->oscDetuneCvAmount, patchCvs_->oscDetune, -1.f, 1.f, patchState_->modAttenuverters, patchState_->cvAttenuverters);
-        SetDetune(d);
+        saw_->SetDetune(d);
 
-        saws_[LEFT_CHANNEL]->Process(f, output.getSamples(LEFT_CHANNEL));
-        saws_[RIGHT_CHANNEL]->Process(f, output.getSamples(RIGHT_CHANNEL));
+        saw_->Process(f, output.getSamples(LEFT_CHANNEL), output.getSamples(RIGHT_CHANNEL));
 
         output.multiply(patchCtrls_->osc2Vol * kOScSuperSawGain);
     }
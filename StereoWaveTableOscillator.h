@@ -18,16 +18,30 @@ private:
     WaveTableBuffer* wtBuffer_;
     BiquadFilter* filters_[2];
     EnvFollower* ef_[2];
+    FloatArray env_;
 
     HysteresisQuantizer offsetQuantizer_;
+    HysteresisQuantizer voicesQuantizer_;
 
     float amp_;
     float oldFreq_;
     float oldOffset_;
-    float phase_;
     float incR_;
     float xi_;
 
+    // Unison voices, as arrays of their parameters.
+    int voices_;
+    float phases_[kWaveTableMaxVoices];
+    float ratios_[kWaveTableMaxVoices];
+    float gainsLeft_[kWaveTableMaxVoices];
+    float gainsRight_[kWaveTableMaxVoices];
+
+    // -1 to 1, 0 for a single voice.
+    inline float VoicePosition(int v)
+    {
+        return voices_ > 1 ? (2.f * v) / (voices_ - 1) - 1.f : 0.f;
+    }
+
 public:
     StereoWaveTableOscillator(PatchCtrls* patchCtrls, PatchCvs* patchCvs, PatchState* patchState, WaveTableBuffer* wtBuffer)
     {
@@ -36,10 +50,10 @@ public:
         patchState_ = patchState;
         wtBuffer_ = wtBuffer;
 
-        phase_ = 0;
         incR_ = kWaveTableLength / patchState_->sampleRate;
 
         offsetQuantizer_.Init(kWaveTableNofTables, 0.f, false);
+        voicesQuantizer_.Init(kWaveTableMaxVoices, 0.15f, false);
 
         oldOffset_ = 0;
         xi_ = 1.f / patchState_->blockSize;
@@ -50,6 +64,10 @@ public:
             filters_[i]->setLowShelf(2000, 1);
             ef_[i] = EnvFollower::create();
         }
+        env_ = FloatArray::create(patchState_->blockSize);
+
+        voices_ = 0;
+        SetUnison(1, 0.f);
     }
     ~StereoWaveTableOscillator()
     {
@@ -58,6 +76,7 @@ public:
             BiquadFilter::destroy(filters_[i]);
             EnvFollower::destroy(ef_[i]);
         }
+        FloatArray::destroy(env_);
     }
 
     static StereoWaveTableOscillator* create(PatchCtrls* patchCtrls, PatchCvs* patchCvs, PatchState* patchState, WaveTableBuffer* wtBuffer)
@@ -70,6 +89,38 @@ public:
         delete osc;
     }
 
+    /**
+     * @brief Sets the number of voices (1 to kWaveTableMaxVoices), detuned
+     *        by up to +/- spread and panned evenly across the stereo field.
+     *        Pans and phases are only reset when the number changes. Each
+     *        voice reads the tables at its own phase, so the cost is linear
+     *        in the number of voices.
+     */
+    void SetUnison(int voices, float spread)
+    {
+        voices = voices < 1 ? 1 : (voices > kWaveTableMaxVoices ? kWaveTableMaxVoices : voices);
+
+        if (voices != voices_)
+        {
+            voices_ = voices;
+            float norm = 1.f / sqrtf(voices_);
+            for (int v = 0; v < voices_; v++)
+            {
+                // Equal power, 1 in the center.
+                float angle = (VoicePosition(v) + 1.f) * M_PI * 0.25f;
+                gainsLeft_[v] = cosf(angle) * M_SQRT2 * norm;
+                gainsRight_[v] = sinf(angle) * M_SQRT2 * norm;
+                // Start out of phase.
+                phases_[v] = (float)v * kWaveTableLength / voices_;
+            }
+        }
+
+        for (int v = 0; v < voices_; v++)
+        {
+            ratios_[v] = 1.f + spread * VoicePosition(v);
+        }
+    }
+
     void Process(AudioBuffer &output)
     {
         size_t size = output.getSize();
@@ -91,35 +142,83 @@ public:
         float o = Modulate(patchCtrls_->oscDetune, patchCtrls_->oscDetuneModAmount, patchState_->modValue, patchCtrls_->oscDetuneCvAmount, patchCvs_->oscDetune, 0, 1.f, patchState_->modAttenuverters, patchState_->cvAttenuverters);
         ParameterInterpolator offsetParam(&oldOffset_, o, size);
 
-        for (size_t i = 0; i < size; i++)
-        {
-            phase_ += freqParam.Next() * incR_;
-            if (phase_ >= kWaveTableLength)
-            {
-                phase_ -= kWaveTableLength;
-            }
+        // Unison voices from the voices control, a single one up to its
+        // default position. Their spread follows the detune.
+        float v = Clamp(Map(patchCtrls_->oscVoices, kOscVoicesDefault, 1.f, 0.f, 1.f));
+        SetUnison(1 + voicesQuantizer_.Process(v), o * kWaveTableUnisonSpread);
+
+        // Band-limited level for the pitch of the highest voice.
+        int level = WaveTableBuffer::GetMipLevel(f * incR_ * ratios_[voices_ - 1]);
+
+        float* left = output.getSamples(LEFT_CHANNEL).getData();
+        float* right = output.getSamples(RIGHT_CHANNEL).getData();
 
-            float p = offsetParam.Next();
-            int q = offsetQuantizer_.Process(p);
-            float p1 = q * kWaveTableStepLength + phase_;
-            float p2 = p1 + kWaveTableStepLength;
-            float x = Clamp((p - kWaveTableNofTablesR * q) / kWaveTableNofTablesR);
+        // The tables are selected once per sub-block, the crossfade between
+        // them still follows the offset sample by sample.
+        for (size_t s = 0; s < size; s += kWaveTableSubBlockSize)
+        {
+            size_t n = std::min<size_t>(kWaveTableSubBlockSize, size - s);
 
-            float left;
-            float right;
-            wtBuffer_->ReadLinear(p1, p2, x, left, right);
+            int q = offsetQuantizer_.Process(offsetParam.subsample(1.f));
+            float base = kWaveTableNofTablesR * q;
 
-            left *= Map(ef_[LEFT_CHANNEL]->process(left), 0.f, 0.3f, kOScWaveTablePreGain, 1.f);
-            right *= Map(ef_[RIGHT_CHANNEL]->process(right), 0.f, 0.3f, kOScWaveTablePreGain, 1.f);
+            WaveTableView view;
+            wtBuffer_->GetView(q, level, view);
+            const float* l1 = view.data[LEFT_CHANNEL][0];
+            const float* l2 = view.data[LEFT_CHANNEL][1];
+            const float* r1 = view.data[RIGHT_CHANNEL][0];
+            const float* r2 = view.data[RIGHT_CHANNEL][1];
 
-            left = SoftClip(left);
-            right = SoftClip(right);
+            for (size_t i = s; i < s + n; i++)
+            {
+                // Increment and crossfade are shared by all the voices.
+                float inc = freqParam.Next() * incR_;
+                float x = Clamp((offsetParam.Next() - base) * kWaveTableNofTables);
+
+                float l = 0;
+                float r = 0;
+                for (int v = 0; v < voices_; v++)
+                {
+                    float phase = phases_[v] + inc * ratios_[v];
+                    if (phase >= kWaveTableLength)
+                    {
+                        phase -= kWaveTableLength;
+                    }
+                    phases_[v] = phase;
+
+                    float p = phase * view.scale;
+                    int j0 = int(p);
+                    int j1 = (j0 + 1) & view.mask;
+                    float f = p - j0;
+
+                    float a = l1[j0] + (l1[j1] - l1[j0]) * f;
+                    float b = l2[j0] + (l2[j1] - l2[j0]) * f;
+                    l += (a + (b - a) * x) * gainsLeft_[v];
+
+                    a = r1[j0] + (r1[j1] - r1[j0]) * f;
+                    b = r2[j0] + (r2[j1] - r2[j0]) * f;
+                    r += (a + (b - a) * x) * gainsRight_[v];
+                }
+                left[i] = l;
+                right[i] = r;
+            }
+        }
 
-            left = filters_[LEFT_CHANNEL]->process(left);
-            right = filters_[RIGHT_CHANNEL]->process(right);
+        // Louder pre-gain for quieter tables, Map(env, 0, 0.3, pre, 1).
+        const float k = (1.f - kOScWaveTablePreGain) / 0.3f;
+        for (size_t c = 0; c < 2; c++)
+        {
+            FloatArray out = output.getSamples(c);
+            float* o = out.getData();
+            float* e = env_.getData();
 
-            output.getSamples(LEFT_CHANNEL)[i] = left * patchCtrls_->osc2Vol * kOScWaveTableGain;
-            output.getSamples(RIGHT_CHANNEL)[i] = right * patchCtrls_->osc2Vol * kOScWaveTableGain;
+            ef_[c]->process(out, env_);
+            for (size_t i = 0; i < size; i++)
+            {
+                o[i] = SoftClip(o[i] * (kOScWaveTablePreGain + k * e[i]));
+            }
+            filters_[c]->process(out, out);
+            out.multiply(patchCtrls_->osc2Vol * kOScWaveTableGain);
         }
     }
 };
\ No newline at end of file
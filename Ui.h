@@ -181,11 +181,15 @@ public:
         lastOctave_ = 3;
         octave_ = 1.f / 8.f * lastOctave_;
         unison_ = 0.55f; // Center is not 0.5
+        patchCtrls_->oscSineMode = 0.f;
+        patchCtrls_->oscVoices = kOscVoicesDefault;
         patchCtrls_->filterMode = 0.f;
         patchCtrls_->filterPosition = 0.f;
         patchCtrls_->modType = 0.f;
         patchCtrls_->resonatorDissonance = 0.f;
+        patchCtrls_->resonatorModel = 0.f;
         patchCtrls_->echoFilter = 0.55f; // Center is not 0.5
+        patchCtrls_->echoPattern = 0.f;
         patchCtrls_->ambienceAutoPan = 0.f;
 
         // Modulation
@@ -233,7 +237,7 @@ public:
             FaderController::create(patchState_, &patchCtrls_->ambienceVol);
 
         knobs_[PARAM_KNOB_LOOPER_SPEED] = KnobController::create(patchState_,
-            &patchCtrls_->looperSpeed, NULL, &patchCtrls_->looperSpeedModAmount,
+            &patchCtrls_->looperSpeed, &patchCtrls_->oscVoices, &patchCtrls_->looperSpeedModAmount,
             &patchCtrls_->looperSpeedCvAmount, 0.005f);
         knobs_[PARAM_KNOB_LOOPER_START] =
             KnobController::create(patchState_, &patchCtrls_->looperStart,
@@ -265,7 +269,7 @@ public:
             &patchCtrls_->resonatorTuneCvAmount, 0.005f);
         knobs_[PARAM_KNOB_RESONATOR_FEEDBACK] =
             KnobController::create(patchState_, &patchCtrls_->resonatorFeedback,
-                NULL, &patchCtrls_->resonatorFeedbackModAmount,
+                &patchCtrls_->resonatorModel, &patchCtrls_->resonatorFeedbackModAmount,
                 &patchCtrls_->resonatorFeedbackCvAmount);
 
         knobs_[PARAM_KNOB_ECHO_DENSITY] =
@@ -273,7 +277,7 @@ public:
                 &patchCtrls_->echoFilter, &patchCtrls_->echoDensityModAmount,
                 &patchCtrls_->echoDensityCvAmount, 0.005f);
         knobs_[PARAM_KNOB_ECHO_REPEATS] = KnobController::create(patchState_,
-            &patchCtrls_->echoRepeats, NULL, &patchCtrls_->echoRepeatsModAmount,
+            &patchCtrls_->echoRepeats, &patchCtrls_->echoPattern, &patchCtrls_->echoRepeatsModAmount,
             &patchCtrls_->echoRepeatsCvAmount);
 
         knobs_[PARAM_KNOB_AMBIENCE_SPACETIME] = KnobController::create(patchState_,
@@ -284,8 +288,8 @@ public:
             &patchCtrls_->ambienceDecay, NULL, &patchCtrls_->ambienceDecayModAmount,
             &patchCtrls_->ambienceDecayCvAmount);
 
-        knobs_[PARAM_KNOB_MOD_LEVEL] =
-            KnobController::create(patchState_, &patchCtrls_->modLevel);
+        knobs_[PARAM_KNOB_MOD_LEVEL] = KnobController::create(
+            patchState_, &patchCtrls_->modLevel, &patchCtrls_->oscSineMode);
         knobs_[PARAM_KNOB_MOD_SPEED] = KnobController::create(
             patchState_, &patchCtrls_->modSpeed, &patchCtrls_->modType);
 
@@ -533,16 +537,25 @@ public:
         Resource* resource = Resource::load(PATCH_SETTINGS_NAME ".alt");
         if (resource != NULL) {
             int16_t* cfg = (int16_t*)resource->getData();
+            int16_t version = cfg[MAX_PATCH_SETTINGS - 1];
+            // The filter mode zones were 0.25 wide before the formant mode
+            // was added at the top, with 0.2 wide zones.
+            float filterModeScale = version < 1 ? 0.8f : 1.f;
             knobs_[PARAM_KNOB_AMBIENCE_SPACETIME]->SetValue(cfg[0] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Ambience auto-pan
             knobs_[PARAM_KNOB_ECHO_DENSITY]->SetValue(cfg[1] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Echo filter
             knobs_[PARAM_KNOB_FILTER_RESONANCE]->SetValue(cfg[2] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Filter position
-            knobs_[PARAM_KNOB_FILTER_CUTOFF]->SetValue(cfg[3] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Filter mode
+            knobs_[PARAM_KNOB_FILTER_CUTOFF]->SetValue(cfg[3] / 8192.f * filterModeScale, LockableParamName::PARAM_LOCKABLE_ALT); // Filter mode
             knobs_[PARAM_KNOB_LOOPER_LENGTH]->SetValue(cfg[4] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Looper filter
             knobs_[PARAM_KNOB_LOOPER_START]->SetValue(cfg[5] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Looper SOS
             knobs_[PARAM_KNOB_MOD_SPEED]->SetValue(cfg[6] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Mod type
             knobs_[PARAM_KNOB_OSC_PITCH]->SetValue(cfg[7] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Octave
             knobs_[PARAM_KNOB_OSC_DETUNE]->SetValue(cfg[8] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Unison
             knobs_[PARAM_KNOB_RESONATOR_TUNE]->SetValue(cfg[9] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Reso dissonance
+            knobs_[PARAM_KNOB_RESONATOR_FEEDBACK]->SetValue(cfg[10] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Reso model
+            knobs_[PARAM_KNOB_ECHO_REPEATS]->SetValue(cfg[11] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Echo pattern
+            knobs_[PARAM_KNOB_MOD_LEVEL]->SetValue(cfg[12] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Sine mode
+            // Files saved before version 2 don't have it.
+            knobs_[PARAM_KNOB_LOOPER_SPEED]->SetValue(version < 2 ? kOscVoicesDefault : cfg[13] / 8192.f, LockableParamName::PARAM_LOCKABLE_ALT); // Osc voices
         }
         Resource::destroy(resource);
     }
@@ -648,6 +661,11 @@ public:
             values[7] = octave_;
             values[8] = unison_;
             values[9] = patchCtrls_->resonatorDissonance;
+            values[10] = patchCtrls_->resonatorModel;
+            values[11] = patchCtrls_->echoPattern;
+            values[12] = patchCtrls_->oscSineMode;
+            values[13] = patchCtrls_->oscVoices;
+            values[MAX_PATCH_SETTINGS - 1] = ALT_PARAMS_VERSION / 8192.f;
             break;
         case FUNC_MODE_MOD:
             values[0] = patchCtrls_->ambienceDecayModAmount;
@@ -1217,11 +1235,14 @@ public:
             LoadAltParams();
             LoadModParams();
             LoadCvParams();
+            patchState_->looperWav->Import(LOOPER_WAV_NAME);
             patchState_->startupPhase = StartupPhase::STARTUP_DONE;
 
             return;
         }
 
+        patchState_->looperWav->Process();
+
         for (size_t i = 0; i < PARAM_KNOB_LAST; i++) {
             knobs_[i]->Read(ParamKnob(i));
         }
@@ -2,24 +2,159 @@
 
 #include "Commons.h"
 #include "Interpolator.h"
+#include "LooperBuffer.h"
+#include "WaveTableCache.h"
 
+/**
+ * @brief A pair of adjacent tables, read with a phase in level 0 samples
+ *        multiplied by scale. The index of the sample after the current one
+ *        must be wrapped with mask.
+ */
+struct WaveTableView
+{
+    const float* data[2][2]; // Channel, table
+    int mask;
+    float scale;
+};
+
+/**
+ * @brief Reads the wavetables out of the looper's buffer. Besides the raw
+ *        audio (level 0) it keeps band-limited copies of each table, every
+ *        level half the length of the previous one, so that high notes can
+ *        be played without aliasing. Levels are rebuilt a chunk per block
+ *        and only for the tables the looper has written into.
+ *        The pair of tables being played is copied to a cache in the
+ *        internal RAM, that's used until the looper writes into them.
+ */
 class WaveTableBuffer
 {
 private:
+    LooperBuffer* looperBuffer_;
     FloatArray* buffer_;
-    int writeHead_;
+    FloatArray mips_;
+    WaveTableCache* cache_;
+
+    uint32_t pending_;
+    int table_;
+    int level_;
+    int index_;
+    int requestTable_;
+    int requestLevel_;
+
+    // Start of a level (> 0) inside the mips of a table.
+    static inline int MipOffset(int level)
+    {
+        return kWaveTableLength - (kWaveTableLength >> (level - 1));
+    }
+
+    inline float* MipData(int channel, int table, int level)
+    {
+        return mips_.getData() + (channel * kWaveTableNofTables + table) * kWaveTableLength + MipOffset(level);
+    }
+
+    // Half-band lowpass and decimation by 2 of a cyclic table (15 taps, the
+    // even ones besides the center are 0).
+    static inline float Decimate(const float* src, int mask, int i)
+    {
+        return 0.5f * src[i] +
+            0.2986f * (src[(i - 1) & mask] + src[(i + 1) & mask]) -
+            0.0588f * (src[(i - 3) & mask] + src[(i + 3) & mask]) +
+            0.0110f * (src[(i - 5) & mask] + src[(i + 5) & mask]) -
+            0.0008f * (src[(i - 7) & mask] + src[(i + 7) & mask]);
+    }
+
+    // Rebuilds up to kWaveTableMipChunk samples of the current table.
+    void Rebuild()
+    {
+        int budget = kWaveTableMipChunk;
+        while (budget > 0 && table_ >= 0)
+        {
+            int length = kWaveTableLength >> level_;
+            int mask = (length << 1) - 1;
+            int n = std::min<int>(budget, length - index_);
+            for (int c = 0; c < 2; c++)
+            {
+                const float* src = (level_ == 1 ? buffer_->getData() + c * kLooperChannelBufferLength + looperBuffer_->GetTableStart(table_) : MipData(c, table_, level_ - 1));
+                float* dst = MipData(c, table_, level_);
+                for (int i = index_; i < index_ + n; i++)
+                {
+                    dst[i] = Decimate(src, mask, i << 1);
+                }
+            }
+            budget -= n;
+            index_ += n;
+            if (index_ == length)
+            {
+                index_ = 0;
+                if (++level_ == kWaveTableMipLevels)
+                {
+                    cache_->Invalidate(1UL << table_, 1);
+                    table_ = -1;
+                }
+            }
+        }
+    }
+
+    // Copies up to kWaveTableCacheChunk samples of the requested tables.
+    void FillCache()
+    {
+        cache_->Request(requestTable_, requestLevel_);
+        if (cache_->Holds(requestTable_, requestLevel_))
+        {
+            return;
+        }
+
+        int level = cache_->GetLevel();
+        int length = kWaveTableLength >> level;
+        int filled = cache_->GetFilled();
+        int n = std::min<int>(kWaveTableCacheChunk, length + 1 - filled);
+        for (int slot = 0; slot < 2; slot++)
+        {
+            int table = (cache_->GetTable() + slot) % kWaveTableNofTables;
+            for (int c = 0; c < 2; c++)
+            {
+                float* dst = cache_->GetData(c, slot);
+                if (level == 0)
+                {
+                    // The sample after the table is the following audio.
+                    memcpy(dst + filled, buffer_->getData() + c * kLooperChannelBufferLength + looperBuffer_->GetTableStart(table) + filled, n * sizeof(float));
+                }
+                else
+                {
+                    const float* src = MipData(c, table, level);
+                    for (int i = filled; i < filled + n; i++)
+                    {
+                        dst[i] = src[i & (length - 1)];
+                    }
+                }
+            }
+        }
+        cache_->Advance(n);
+    }
 
 public:
-    WaveTableBuffer(FloatArray* buffer)
+    WaveTableBuffer(LooperBuffer* looperBuffer, WaveTableCache* cache)
     {
-        buffer_ = buffer;
-        writeHead_ = 0;
+        looperBuffer_ = looperBuffer;
+        cache_ = cache;
+        buffer_ = looperBuffer_->GetBuffer();
+        mips_ = FloatArray::create(2 * kWaveTableNofTables * kWaveTableLength);
+
+        pending_ = 0;
+        table_ = -1;
+        level_ = 1;
+        index_ = 0;
+        requestTable_ = 0;
+        requestLevel_ = 0;
+    }
+    ~WaveTableBuffer()
+    {
+        FloatArray::destroy(mips_);
     }
-    ~WaveTableBuffer() {}
 
-    static WaveTableBuffer* create(FloatArray* buffer)
+    static WaveTableBuffer* create(LooperBuffer* looperBuffer, WaveTableCache* cache)
     {
-        return new WaveTableBuffer(buffer);
+        return new WaveTableBuffer(looperBuffer, cache);
     }
 
     static void destroy(WaveTableBuffer* obj)
@@ -72,4 +207,81 @@ public:
         left = Interpolator::linear(ReadLeft(i1), ReadLeft(i1 + 1), f1) * x0 + Interpolator::linear(ReadLeft(i2), ReadLeft(i2 + 1), f2) * x;
         right = Interpolator::linear(ReadRight(i1), ReadRight(i1 + 1), f1) * x0 + Interpolator::linear(ReadRight(i2), ReadRight(i2 + 1), f2) * x;
     }
+
+    /**
+     * @brief Points the view to two adjacent tables at the given mip level,
+     *        wherever they are currently stored. Valid until the next Update.
+     */
+    inline void GetView(int table, int level, WaveTableView &view)
+    {
+        table %= kWaveTableNofTables;
+        int next = (table + 1) % kWaveTableNofTables;
+        int length = kWaveTableLength >> level;
+
+        requestTable_ = table;
+        requestLevel_ = level;
+
+        view.scale = 1.f / (1 << level);
+        if (cache_->Holds(table, level))
+        {
+            // Tables are followed by the sample for the interpolation.
+            for (int c = 0; c < 2; c++)
+            {
+                view.data[c][0] = cache_->GetData(c, 0);
+                view.data[c][1] = cache_->GetData(c, 1);
+            }
+            view.mask = (length << 1) - 1;
+        }
+        else if (level == 0)
+        {
+            for (int c = 0; c < 2; c++)
+            {
+                float* data = buffer_->getData() + c * kLooperChannelBufferLength;
+                view.data[c][0] = data + looperBuffer_->GetTableStart(table);
+                view.data[c][1] = data + looperBuffer_->GetTableStart(next);
+            }
+            view.mask = (length << 1) - 1;
+        }
+        else
+        {
+            for (int c = 0; c < 2; c++)
+            {
+                view.data[c][0] = MipData(c, table, level);
+                view.data[c][1] = MipData(c, next, level);
+            }
+            view.mask = length - 1;
+        }
+    }
+
+    /**
+     * @brief Lowest level that doesn't alias when the tables are read with
+     *        the given increment (in level 0 samples).
+     */
+    static inline int GetMipLevel(float increment)
+    {
+        int level = 0;
+        while (level < kWaveTableMipLevels - 1 && (1 << level) < increment)
+        {
+            level++;
+        }
+
+        return level;
+    }
+
+    // Called at block rate
+    void Update()
+    {
+        uint32_t dirty = looperBuffer_->TakeDirtyTables();
+        cache_->Invalidate(dirty, 0);
+        pending_ |= dirty;
+        if (table_ < 0 && pending_)
+        {
+            for (table_ = 0; !(pending_ & (1UL << table_)); table_++);
+            pending_ &= ~(1UL << table_);
+            level_ = 1;
+            index_ = 0;
+        }
+        Rebuild();
+        FillCache();
+    }
 };
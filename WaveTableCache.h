@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Commons.h"
+
+/**
+ * @brief Copy of the pair of wavetables the oscillator is playing, at the
+ *        mip level it's using, so that it doesn't have to read the SDRAM.
+ *        It's filled a chunk per block and must be allocated before the
+ *        looper's buffer to end up in the internal RAM.
+ */
+class WaveTableCache
+{
+private:
+    // One extra sample for the interpolation.
+    float data_[2][2][kWaveTableLength + 1];
+
+    int table_;
+    int level_;
+    int filled_;
+
+    bool valid_;
+
+public:
+    WaveTableCache()
+    {
+        table_ = -1;
+        level_ = 0;
+        filled_ = 0;
+        valid_ = false;
+    }
+    ~WaveTableCache() {}
+
+    static WaveTableCache* create()
+    {
+        return new WaveTableCache();
+    }
+
+    static void destroy(WaveTableCache* obj)
+    {
+        delete obj;
+    }
+
+    inline bool Holds(int table, int level)
+    {
+        return valid_ && table == table_ && level == level_;
+    }
+
+    /**
+     * @brief Starts filling the cache with a table and the following one,
+     *        if it isn't already doing it.
+     */
+    inline void Request(int table, int level)
+    {
+        if (table != table_ || level != level_)
+        {
+            table_ = table;
+            level_ = level;
+            filled_ = 0;
+            valid_ = false;
+        }
+    }
+
+    /**
+     * @brief Drops the content if it comes from one of the given tables (one
+     *        bit per table) at the given level or above.
+     */
+    inline void Invalidate(uint32_t tables, int level)
+    {
+        int next = (table_ + 1) % kWaveTableNofTables;
+        if (table_ >= 0 && level_ >= level && (tables & ((1UL << table_) | (1UL << next))))
+        {
+            filled_ = 0;
+            valid_ = false;
+        }
+    }
+
+    inline int GetTable()
+    {
+        return table_;
+    }
+
+    inline int GetLevel()
+    {
+        return level_;
+    }
+
+    inline int GetFilled()
+    {
+        return filled_;
+    }
+
+    inline float* GetData(int channel, int slot)
+    {
+        return data_[channel][slot];
+    }
+
+    // Counts the samples copied into the cache.
+    inline void Advance(int n)
+    {
+        filled_ += n;
+        if (filled_ == (kWaveTableLength >> level_) + 1)
+        {
+            valid_ = true;
+        }
+    }
+};
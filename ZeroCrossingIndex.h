@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Commons.h"
+
+/**
+ * @brief Keeps, for each wavetable segment of the looper's buffer, the start
+ *        of the table that loops most smoothly: a rising zero crossing whose
+ *        sample kWaveTableLength later is a rising zero crossing too, with
+ *        the closest value and slope. Updated while the looper records, the
+ *        channels are summed so both use the same start.
+ */
+class ZeroCrossingIndex
+{
+private:
+    static constexpr float kNoScore = 1e9f;
+
+    FloatArray* buffer_;
+
+    int offsets_[kWaveTableNofTables];
+    float scores_[kWaveTableNofTables];
+
+    int lastTable_;
+    float last_;
+
+    inline float Mid(uint32_t i)
+    {
+        return buffer_->getData()[i] + buffer_->getData()[i + kLooperChannelBufferLength];
+    }
+
+public:
+    ZeroCrossingIndex(FloatArray* buffer)
+    {
+        buffer_ = buffer;
+
+        for (size_t i = 0; i < kWaveTableNofTables; i++)
+        {
+            offsets_[i] = 0;
+            scores_[i] = 0;
+        }
+
+        lastTable_ = -1;
+        last_ = 0;
+    }
+    ~ZeroCrossingIndex() {}
+
+    static ZeroCrossingIndex* create(FloatArray* buffer)
+    {
+        return new ZeroCrossingIndex(buffer);
+    }
+
+    static void destroy(ZeroCrossingIndex* obj)
+    {
+        delete obj;
+    }
+
+    /**
+     * @brief Called when a new take starts, so that the first segment it
+     *        writes drops its previous start even if the last take ended
+     *        there.
+     */
+    void Reset()
+    {
+        lastTable_ = -1;
+        last_ = 0;
+    }
+
+    /**
+     * @brief Start of a table in the channel.
+     */
+    inline int GetTableStart(int table)
+    {
+        return table * kWaveTableStepLength + offsets_[table];
+    }
+
+    /**
+     * @brief Scans a span that has just been written. The span must not
+     *        cross the end of the channel.
+     */
+    void Scan(uint32_t i, size_t size)
+    {
+        for (uint32_t p = i; p < i + size; p++)
+        {
+            float x = Mid(p);
+            int q = p / kWaveTableStepLength;
+            int o = p - q * kWaveTableStepLength;
+
+            // Entering a segment, the previous start has been recorded over.
+            if (q != lastTable_)
+            {
+                lastTable_ = q;
+                scores_[q] = kNoScore;
+            }
+
+            // p is the end of a table starting at s, the table and the sample
+            // after it (for the interpolation) are always within the segment.
+            if (last_ < 0 && x >= 0 && o > kWaveTableLength)
+            {
+                uint32_t s = p - kWaveTableLength;
+                float xs = Mid(s);
+                float xs1 = Mid(s - 1);
+                if (xs1 < 0 && xs >= 0)
+                {
+                    float score = fabsf(xs - x) + fabsf((xs - xs1) - (x - last_));
+                    if (score < scores_[q])
+                    {
+                        scores_[q] = score;
+                        offsets_[q] = s - q * kWaveTableStepLength;
+                    }
+                }
+            }
+
+            last_ = x;
+        }
+    }
+};